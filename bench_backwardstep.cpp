@@ -0,0 +1,110 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <sdsl/io.hpp>
+#include <string>
+#include <vector>
+
+#include "perf_counters.hpp"
+#include "tfm_index.hpp"
+
+using namespace std;
+using namespace sdsl;
+
+typedef typename sdsl::int_vector<>::size_type size_type;
+
+void printUsage(char **argv) {
+    cerr << "USAGE: " << argv[0] << " TFMFILE [K] [STEPS]" << endl;
+    cerr << "TFMFILE:" << endl;
+    cerr << "  File with the serialized index" << endl;
+    cerr << "K:" << endl;
+    cerr << "  Number of walks advanced in lockstep (default 16)" << endl;
+    cerr << "STEPS:" << endl;
+    cerr << "  Number of steps per walk (default size / K)" << endl;
+};
+
+// returns k states evenly spread over the backward walk from tfm.end()
+vector<tfm_index::nav_type> start_states(tfm_index &tfm, size_type k) {
+    vector<tfm_index::nav_type> states;
+    auto p = tfm.end();
+    for (size_type i = 0; i < tfm.size() && states.size() < k; i++) {
+        if (i % (tfm.size() / k) == 0) states.push_back(p);
+        tfm.backwardstep(p);
+    }
+    return states;
+}
+
+double seconds_since(chrono::steady_clock::time_point start) {
+    chrono::duration<double> d = chrono::steady_clock::now() - start;
+    return d.count();
+}
+
+// prints the counted events of region name per step, if any is available
+void print_counters(const string &name, double steps) {
+    for (auto &r : perf_counters::global().regions()) {
+        if (r.name != name) continue;
+        cout << name << " per step:";
+        for (size_t e = 0; e < perf_counters::events; e++) {
+            if (perf_counters::global().has(e)) {
+                cout << "\t" << perf_counters::name(e) << " " << r.counts[e] / steps;
+            }
+        }
+        cout << endl;
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        printUsage(argv);
+        cerr << "At least 1 parameter expected" << endl;
+        return 1;
+    }
+
+    tfm_index tfm;
+    if (!load_index_from_file(tfm, argv[1])) return 1;
+    size_type k = (argc > 2) ? atoi(argv[2]) : 16;
+    k = max((size_type)1, min(k, tfm.size()));
+    size_type steps = (argc > 3) ? atoi(argv[3]) : tfm.size() / k;
+    vector<tfm_index::nav_type> states = start_states(tfm, k);
+    perf_counters::global().open();
+
+    // scalar: one walk after the other
+    vector<tfm_index::nav_type> pos = states;
+    uint64_t scalar_sum = 0;
+    auto start = chrono::steady_clock::now();
+    {
+        perf_scope counters("scalar");
+        for (size_type j = 0; j < k; j++) {
+            for (size_type i = 0; i < steps; i++) {
+                scalar_sum += tfm.backwardstep(pos[j]);
+            }
+        }
+    }
+    double scalar_time = seconds_since(start);
+
+    // batched: all walks in lockstep
+    pos = states;
+    vector<tfm_index::value_type> c(k);
+    uint64_t batched_sum = 0;
+    start = chrono::steady_clock::now();
+    {
+        perf_scope counters("batched");
+        for (size_type i = 0; i < steps; i++) {
+            tfm.backwardstep(pos.data(), c.data(), k);
+            for (size_type j = 0; j < k; j++) batched_sum += c[j];
+        }
+    }
+    double batched_time = seconds_since(start);
+
+    if (scalar_sum != batched_sum) {
+        cerr << "Scalar and batched walks differ" << endl;
+        return 1;
+    }
+    double total = (double)k * steps;
+    cout << "walks: " << k << "\tsteps: " << steps << endl;
+    cout << "scalar:\t" << scalar_time * 1e9 / total << " ns/step" << endl;
+    cout << "batched:\t" << batched_time * 1e9 / total << " ns/step" << endl;
+    print_counters("scalar", total);
+    print_counters("batched", total);
+    return 0;
+}
@@ -0,0 +1,69 @@
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sdsl/io.hpp>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "tfm_count_support.hpp"
+#include "tfm_index.hpp"
+
+using namespace std;
+using namespace sdsl;
+
+void printUsage(char **argv) {
+    cerr << "USAGE: " << argv[0] << " TFMFILE TEXTFILE [M] [Q]" << endl;
+    cerr << "TFMFILE:" << endl;
+    cerr << "  File with the serialized index of TEXTFILE" << endl;
+    cerr << "TEXTFILE:" << endl;
+    cerr << "  File with the text the patterns are drawn from" << endl;
+    cerr << "M:" << endl;
+    cerr << "  Maximal pattern length, lengths 1, 2, 4, ..., M are run "
+            "(default 64)"
+         << endl;
+    cerr << "Q:" << endl;
+    cerr << "  Number of patterns per length (default 10000)" << endl;
+};
+
+double seconds_since(chrono::steady_clock::time_point start) {
+    chrono::duration<double> d = chrono::steady_clock::now() - start;
+    return d.count();
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        printUsage(argv);
+        cerr << "At least 2 parameter expected" << endl;
+        return 1;
+    }
+
+    tfm_index tfm;
+    if (!load_index_from_file(tfm, argv[1])) return 1;
+    tfm_count_support<> cnt(&tfm);
+
+    ifstream in(argv[2]);
+    stringstream ss;
+    ss << in.rdbuf();
+    string text = ss.str();
+    size_t max_m = (argc > 3) ? atoi(argv[3]) : 64;
+    size_t q = (argc > 4) ? atoi(argv[4]) : 10000;
+
+    // substrings of the text at positions drawn with a fixed seed
+    mt19937_64 rng(42);
+    cout << "m\tpatterns/s\tchars/s\tavg count" << endl;
+    for (size_t m = 1; m <= max_m && m <= text.size(); m *= 2) {
+        vector<string> patterns(q);
+        for (auto &p : patterns) p = text.substr(rng() % (text.size() - m + 1), m);
+
+        uint64_t occ = 0;
+        auto start = chrono::steady_clock::now();
+        for (auto &p : patterns) occ += cnt.count(p);
+        double time = seconds_since(start);
+        cout << m << "\t" << q / time << "\t" << q * m / time << "\t"
+             << (double)occ / q << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,173 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "pfp_wg.hpp"
+#include "synthetic.hpp"
+#include "tfm_index.hpp"
+
+using namespace std;
+using namespace sdsl;
+
+void printUsage(char **argv) {
+    cerr << "USAGE: " << argv[0] << " [MAX_MB] [SEED]" << endl;
+    cerr << "MAX_MB:" << endl;
+    cerr << "  Largest input size in MB, sizes 1, 4, 16, ... up to MAX_MB are "
+            "run (default 16)"
+         << endl;
+    cerr << "SEED:" << endl;
+    cerr << "  Seed of the generated inputs (default 42)" << endl;
+};
+
+double seconds_since(chrono::steady_clock::time_point start) {
+    chrono::duration<double> d = chrono::steady_clock::now() - start;
+    return d.count();
+}
+
+void report(const string &kernel, size_t n, double time, double units, const string &unit) {
+    cout << kernel << "\t" << n / (1 << 20) << "\t" << time << "\t"
+         << units / time << "\t" << unit << endl;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && argv[1][0] == '-') {
+        printUsage(argv);
+        return 1;
+    }
+    size_t max_mb = (argc > 1) ? atoi(argv[1]) : 16;
+    uint64_t seed = (argc > 2) ? strtoull(argv[2], nullptr, 10) : 42;
+    const size_t w = 10, p = 100;
+    string tmp_file = "bench_kernels.tmp";
+
+    cout << "kernel\tMB\ttime s\tthroughput\tunit" << endl;
+    for (size_t mb = 1; mb <= max_mb; mb *= 4) {
+        // 16 variants of a base of mb / 16 MB with 1 substitution per 1000 bases
+        synthetic_params params;
+        params.length = (mb << 20) / 16;
+        params.indel_rate = 0;
+        params.seed = seed;
+        string text = synthetic_collection(params).str();
+        size_t n = text.size();
+
+        // KR_window::addchar over the text
+        uint64_t sink = 0;
+        KR_window krw(w);
+        auto start = chrono::steady_clock::now();
+        for (char c : text) sink ^= krw.addchar((unsigned char)c);
+        report("KR_window::addchar", n, seconds_since(start), n, "B/s");
+
+        // phrase boundaries as found by process_file
+        vector<size_t> ends;
+        krw.reset();
+        for (size_t i = 0; i < n; i++) {
+            if (krw.addchar((unsigned char)text[i]) % p == 0) ends.push_back(i + 1);
+        }
+
+        // kr_hash of the phrases
+        size_t hashed = 0;
+        start = chrono::steady_clock::now();
+        for (size_t k = 1; k < ends.size(); k++) {
+            size_t b = ends[k - 1] >= w ? ends[k - 1] - w : 0;
+            sink ^= kr_hash(text.substr(b, ends[k] - b));
+            hashed += ends[k] - b;
+        }
+        report("kr_hash", n, seconds_since(start), hashed, "B/s");
+
+        // save_update_word on the phrases in text order
+        {
+            map<uint64_t, word_stats> freq;
+            vector<uint64_t> parse;
+            uint64_t pos = 0;
+            string word(1, Dollar);
+            size_t b = 0;
+            start = chrono::steady_clock::now();
+            for (size_t e : ends) {
+                word.append(text, b, e - b);
+                b = e;
+                save_update_word(word, w, freq, parse, pos);
+            }
+            report("save_update_word", n, seconds_since(start), ends.size(), "phrases/s");
+        }
+
+        // the remaining kernels run on the pipeline of the text
+        ofstream(tmp_file) << text;
+        vector<uint64_t> parse;
+        Dict dict;
+        size_t size;
+        pf_parse(tmp_file, w, p, parse, dict, &size);
+        remove(tmp_file.c_str());
+
+        // gsacak_int on the parse, prepared as in compute_bwt
+        {
+            uint64_t sigma = 0;
+            for (auto x : parse) sigma = max(sigma, x);
+            sigma += 1 + 2;
+            size_t m = parse.size() + 2;
+            vector<uint32_t> t(m), sa(m);
+            for (size_t i = 0; i < parse.size(); i++) t[i] = parse[i] + 2;
+            t[m - 2] = 1;
+            t[m - 1] = 0;
+            start = chrono::steady_clock::now();
+            gsacak_int(t.data(), sa.data(), NULL, NULL, m, sigma);
+            report("gsacak_int", n, seconds_since(start), m, "symbols/s");
+        }
+
+        // minimize_dbg_edges through find_min_dbg, as in construct_tfm_index
+        vector<uint64_t> bwt = compute_bwt(parse);
+        {
+            int_vector<> L(bwt.size(), 0);
+            for (size_t i = 0; i < bwt.size(); i++) L[i] = bwt[i];
+            wt_blcd_int<> wt_L;
+            construct_im(wt_L, L);
+            vector<uint64_t> C = tfm_index::get_C(L, wt_L.sigma);
+            bit_vector din;
+            start = chrono::steady_clock::now();
+            dbg_algorithms::find_min_dbg(wt_L, C, din);
+            report("minimize_dbg_edges", n, seconds_since(start), bwt.size(), "symbols/s");
+        }
+        pair<size_t, size_t> min_dbg;
+        tfm_index tfmp = construct_tfm_index(bwt, &min_dbg);
+
+        // tfm_index::backwardstep over the whole unparsed text, unparse
+        // sets the first symbol of the dictionary, which is restored after
+        uint8_t d0 = dict.d[0];
+        tfm_index tfm = unparse(tfmp, dict, w, size, 1, false, false);
+        dict.d[0] = d0;
+        auto pos = tfm.end();
+        start = chrono::steady_clock::now();
+        for (size_t i = 0; i < tfm.size(); i++) sink ^= tfm.backwardstep(pos);
+        report("tfm_index::backwardstep", n, seconds_since(start), tfm.size(), "steps/s");
+
+        // compute_L measuring the output of the whole dictionary, prepared
+        // as in unparse
+        {
+            int_vector<> parse_L = tfmp.decode_L();
+            vector<uint32_t> ilist(parse_L.size() - 1);
+            generate_ilist(ilist.data(), parse_L, dict.dwords);
+            vector<uint32_t> occ(dict.dwords);
+            for (uint64_t i = 0; i < dict.dwords; i++) {
+                occ[i] = tfmp.C[i + 2] - tfmp.C[i + 1];
+            }
+            vector<uint32_t> sa(dict.dsize);
+            vector<int32_t> lcp(dict.dsize);
+            gsacak(dict.d.get(), sa.data(), lcp.data(), NULL, dict.dsize);
+            dict.d[0] = 0;
+            vector<long> bounds = partition_sa(dict, w, sa.data(), lcp.data(), 1);
+            unparse_size sizes;
+            start = chrono::steady_clock::now();
+            compute_L(bounds.front(), bounds.back(), w, dict, ilist.data(), tfmp,
+                      parse_L, occ, sa.data(), lcp.data(), sizes);
+            report("compute_L", n, seconds_since(start), size, "B/s");
+        }
+
+        // keeps the results of the kernels alive
+        cerr << "checksum: " << sink << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,61 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sdsl/io.hpp>
+#include <string>
+
+#include "tfm_index.hpp"
+
+using namespace std;
+using namespace sdsl;
+
+void printUsage(char **argv) {
+    cerr << "USAGE: " << argv[0] << " TFMFILE [R]" << endl;
+    cerr << "TFMFILE:" << endl;
+    cerr << "  File with the serialized index, it is stored next to it in "
+            "both layouts"
+         << endl;
+    cerr << "R:" << endl;
+    cerr << "  Number of loads per layout (default 5)" << endl;
+};
+
+double seconds_since(chrono::steady_clock::time_point start) {
+    chrono::duration<double> d = chrono::steady_clock::now() - start;
+    return d.count();
+}
+
+size_t file_size(const string &file) {
+    ifstream in(file, ios::binary | ios::ate);
+    return in ? (size_t)in.tellg() : 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        printUsage(argv);
+        cerr << "At least 1 parameter expected" << endl;
+        return 1;
+    }
+    size_t r = (argc > 2) ? atoi(argv[2]) : 5;
+
+    tfm_index tfm;
+    if (!load_index_from_file(tfm, argv[1])) return 1;
+    string full = string(argv[1]) + ".bench_full";
+    string compact = string(argv[1]) + ".bench_compact";
+    store_to_file(tfm, full);
+    store_compact_to_file(tfm, compact);
+    sdsl::util::clear(tfm);
+
+    cout << "layout\tbytes\tload s" << endl;
+    for (auto &file : {full, compact}) {
+        auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < r; i++) {
+            tfm_index loaded;
+            load_from_file(loaded, file);
+        }
+        cout << (file == full ? "full" : "compact") << "\t" << file_size(file)
+             << "\t" << seconds_since(start) / r << endl;
+        remove(file.c_str());
+    }
+    return 0;
+}
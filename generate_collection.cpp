@@ -0,0 +1,95 @@
+#include <getopt.h>
+#include <stdlib.h>
+
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "synthetic.hpp"
+
+using namespace std;
+
+struct Args {
+    synthetic_params params;
+    string output;
+};
+
+void print_help(char **argv) {
+    cout << "Usage: " << argv[0] << " -l 1000000 -n 16 -o output.txt" << endl
+         << "\tOptions: " << endl
+         << "\t-l L\tlength of the base genome (default 1048576)" << endl
+         << "\t-n N\tnumber of variants (default 16)" << endl
+         << "\t-s S\tsubstitutions per base (default 0.001)" << endl
+         << "\t-d D\tinsertions and deletions per base (default 0.0001)" << endl
+         << "\t-m M\tlongest insertion or deletion (default 10)" << endl
+         << "\t-a A\talphabet (default ACGT)" << endl
+         << "\t-r R\tseed (default 42)" << endl
+         << "\t-o O\toutput file (text)" << endl
+         << "\t-h  \tshow help and exit" << endl;
+}
+
+Args parse_args(int argc, char **argv) {
+    extern char *optarg;
+
+    Args arg;
+    int c;
+
+    while ((c = getopt(argc, argv, "l:n:s:d:m:a:r:o:h")) != -1) {
+        switch (c) {
+            case 'l':
+                arg.params.length = stoull(optarg);
+                break;
+            case 'n':
+                arg.params.variants = stoull(optarg);
+                break;
+            case 's':
+                arg.params.snp_rate = stod(optarg);
+                break;
+            case 'd':
+                arg.params.indel_rate = stod(optarg);
+                break;
+            case 'm':
+                arg.params.max_indel = stoull(optarg);
+                break;
+            case 'a':
+                arg.params.alphabet.assign(optarg);
+                break;
+            case 'r':
+                arg.params.seed = stoull(optarg);
+                break;
+            case 'o':
+                arg.output.assign(optarg);
+                break;
+            case 'h':
+                print_help(argv);
+                exit(1);
+            case '?':
+                cout << "Unknown option. Use -h for help." << endl;
+                exit(1);
+        }
+    }
+    return arg;
+}
+
+int main(int argc, char **argv) {
+    Args arg = parse_args(argc, argv);
+    if (arg.output.empty()) {
+        print_help(argv);
+        return 1;
+    }
+    // bytes 0, 1 and 2 delimit the phrases and the dictionary of the parse
+    for (char c : arg.params.alphabet) {
+        if ((unsigned char)c <= 2) {
+            cerr << "The alphabet cannot contain the bytes 0, 1 and 2" << endl;
+            return 1;
+        }
+    }
+
+    ofstream out(arg.output, ios::binary);
+    synthetic_collection(arg.params).write(out);
+    if (!out) {
+        cerr << "Error writing " << arg.output << endl;
+        return 1;
+    }
+    return 0;
+}
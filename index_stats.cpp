@@ -0,0 +1,120 @@
+#include <algorithm>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sdsl/io.hpp>
+#include <string>
+#include <vector>
+
+#include "tfm_index.hpp"
+
+using namespace std;
+using namespace sdsl;
+
+typedef tfm_index::size_type size_type;
+
+void printUsage(char **argv) {
+    cerr << "USAGE: " << argv[0] << " TFMFILE" << endl;
+    cerr << "TFMFILE:" << endl;
+    cerr << "  File with the serialized index" << endl;
+};
+
+// prints the components of the structure tree below v, largest first
+void print_tree(const structure_tree_node *v, size_type total, size_type text_len,
+                int depth) {
+    vector<const structure_tree_node *> children;
+    for (auto &c : v->children) children.push_back(c.second.get());
+    sort(children.begin(), children.end(),
+         [](const structure_tree_node *a, const structure_tree_node *b) {
+             return a->size > b->size;
+         });
+    for (auto c : children) {
+        string name = string(2 * depth, ' ') + c->name;
+        cout << left << setw(32) << name << right << setw(14) << c->size
+             << setw(9) << fixed << setprecision(2) << 100.0 * c->size / total << "%"
+             << setw(10) << setprecision(4) << 8.0 * c->size / text_len
+             << "  " << c->type << endl;
+        print_tree(c, total, text_len, depth + 1);
+    }
+}
+
+// counts the blocks of a bitvector that start with a one, by length
+template <class t_bv>
+map<size_type, size_type> block_lengths(const t_bv &bv) {
+    map<size_type, size_type> lengths;
+    size_type start = 0;
+    for (size_type i = 1; i <= bv.size(); i++) {
+        if (i == bv.size() || bv[i]) {
+            if (bv[start]) lengths[i - start]++;
+            start = i;
+        }
+    }
+    return lengths;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        printUsage(argv);
+        cerr << "At least 1 parameter expected" << endl;
+        return 1;
+    }
+
+    tfm_index tfm;
+    if (!load_index_from_file(tfm, argv[1])) return 1;
+    size_type n = max(tfm.size(), (size_type)1);
+
+    // the structure tree recorded by serialize
+    structure_tree_node root("root", "root");
+    nullstream ns;
+    size_type total = tfm.serialize(ns, &root, "tfm_index");
+
+    cout << "text length:       " << tfm.size() << endl;
+    cout << "tunneled L length: " << tfm.L.size() << endl;
+    if (tfm.L.rle()) cout << "runs of L:         " << tfm.L.runs() << endl;
+    cout << "alphabet size:     " << tfm.C.size() - 1 << endl;
+    cout << "index bytes:       " << total << endl;
+    cout << "bits per symbol:   " << fixed << setprecision(4) << 8.0 * total / n
+         << endl;
+    cout << endl;
+    cout << left << setw(32) << "component" << right << setw(14) << "bytes"
+         << setw(10) << "share" << setw(10) << "bits/sym" << "  type" << endl;
+    print_tree(&root, max(total, (size_type)1), n, 0);
+
+    // a tunnel of width k is entered at a node with k entries, the block of
+    // a one and k - 1 zeros in din, and left at a node with k exits in dout
+    map<size_type, size_type> entries = block_lengths(tfm.din);
+    map<size_type, size_type> exits = block_lengths(tfm.dout);
+    size_type nodes = 0, tunnels = 0, exit_cnt = 0;
+    for (auto &e : entries) {
+        nodes += e.second;
+        if (e.first > 1) tunnels += e.second;
+    }
+    for (auto &e : exits) {
+        if (e.first > 1) exit_cnt += e.second;
+    }
+    cout << endl;
+    cout << "nodes:             " << nodes << endl;
+    cout << "tunnels:           " << tunnels << " (" << exit_cnt << " exits)"
+         << endl;
+
+    // widths in powers of two, [2, 2], [3, 4], [5, 8], ...
+    map<size_type, pair<size_type, size_type>> hist;
+    for (auto &e : entries) {
+        if (e.first < 2) continue;
+        size_type hi = 2;
+        while (hi < e.first) hi *= 2;
+        hist[hi].first += e.second;
+        hist[hi].second += e.second * e.first;
+    }
+    cout << endl;
+    cout << left << setw(16) << "tunnel width" << right << setw(14) << "tunnels"
+         << setw(16) << "entries" << endl;
+    for (auto &h : hist) {
+        string range = h.first == 2 ? "2" : to_string(h.first / 2 + 1) + "-" +
+                                                to_string(h.first);
+        cout << left << setw(16) << range << right << setw(14) << h.second.first
+             << setw(16) << h.second.second << endl;
+    }
+    return 0;
+}
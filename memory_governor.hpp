@@ -0,0 +1,112 @@
+#ifndef MEMORY_GOVERNOR_HPP
+#define MEMORY_GOVERNOR_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+//! estimates the peak memory of the construction stages from the sizes
+//! known before each of them and chooses the variants which fit a limit.
+//!
+//! n is the length of the text, m the length of the parse, d the size of
+//! the dictionary in chars and k the number of its phrases. an estimate
+//! counts the large buffers of its stage and those of earlier stages which
+//! are still alive, the buffers are freed as soon as their stage has read
+//! them. check throws before a stage starts if even its smallest variant
+//! does not fit, so that a build fails early and with a clear message
+//! instead of at the limit of the machine. the estimates are not a hard
+//! ceiling, the allocations themselves are not limited.
+//!
+//! the dictionary is not known before the parse ends, so the parse is
+//! checked while it runs, with the bytes of the phrases found so far. the
+//! runs of a run-length encoded L are checked once they are counted by the
+//! measuring pass of the unparse.
+class memory_governor {
+    size_t m_limit; // bytes, 0 for no limit
+
+    // bytes of an int_vector of m symbols below k + 3, as bit_compress
+    static size_t symbol_bytes(size_t m, size_t k) {
+        size_t bits = 1;
+        for (size_t x = k + 3; x >>= 1;) bits++;
+        return m * bits / 8 + 8;
+    }
+
+  public:
+    explicit memory_governor(size_t limit = 0) : m_limit(limit) {}
+
+    size_t limit() const { return m_limit; }
+
+    bool fits(size_t bytes) const { return m_limit == 0 || bytes <= m_limit; }
+
+    //! a distinct phrase of len chars in the frequencies of the parse: the
+    //! node of the map, its string and the chars
+    static size_t phrase_bytes(size_t len) { return 96 + len; }
+
+    //! the parse while it runs: the frequencies of its distinct phrases, of
+    //! phrases bytes, and the parse of capacity m
+    static size_t parse_bytes(size_t phrases, size_t m) { return phrases + 8 * m; }
+
+    //! the end of the parse: the frequencies, the parse and its remapped
+    //! copy, the sorted phrases and the dictionary read from them
+    static size_t remap_bytes(size_t phrases, size_t m, size_t d, size_t k) {
+        return phrases + 16 * m + d + 8 * k + dict_bytes(d, k);
+    }
+
+    //! the dictionary: its chars and the ends and preceding chars of the
+    //! phrases, alive from the parse to the end of the unparse
+    static size_t dict_bytes(size_t d, size_t k) { return d + 9 * k; }
+
+    //! the BWT of the parse: the parse until it is copied into the text of
+    //! gsacak, the text, its suffix array and the BWT
+    static size_t bwt_bytes(size_t m) {
+        return std::max(8 * m + 4 * (m + 2), 8 * (m + 2) + 8 * m);
+    }
+
+    //! the index of the parse: the BWT until it is copied into L, L, its
+    //! wavelet tree, din, dout and C
+    static size_t tunnel_bytes(size_t m, size_t k) {
+        size_t L = symbol_bytes(m, k);
+        return std::max(8 * m + L, 3 * L + m / 4 + 8 * (k + 3));
+    }
+
+    //! the unparse: din and dout, the suffix and lcp arrays of the
+    //! dictionary, the inverted list and L of the parse, the occurrences of
+    //! the phrases and the unparsed L, in memory or a window of an eighth of
+    //! it on disk. then the wavelet tree of L, which is streamed from disk
+    //! in the second variant. the dictionary and the index of the parse
+    //! are added by the caller
+    static size_t unparse_bytes(size_t n, size_t d, size_t m, size_t k, bool on_disk) {
+        size_t L = on_disk ? n / 8 : n;
+        size_t work = n / 4 + 8 * d + 8 * m + 4 * k + L;
+        size_t wt = n + n / 4 + n / 4 + (on_disk ? 0 : n);
+        return std::max(work, wt);
+    }
+
+    //! the unparse into r runs: din and dout, the work of the unparse and
+    //! the runs of the slices merged into one list, then the run-length
+    //! encoded L built from the list
+    static size_t rle_bytes(size_t n, size_t d, size_t m, size_t k, size_t r) {
+        size_t work = n / 4 + 8 * d + 8 * m + 4 * k + 32 * r;
+        size_t rle = n / 4 + n / 4 + 40 * r;
+        return std::max(work, rle);
+    }
+
+    //! returns whether the unparse has to keep L on disk, live are the
+    //! bytes alive alongside it
+    bool unparse_on_disk(size_t n, size_t d, size_t m, size_t k, size_t live) const {
+        return !fits(live + unparse_bytes(n, d, m, k, false));
+    }
+
+    //! throws std::runtime_error if stage needs more bytes than the limit
+    void check(const std::string &stage, size_t bytes) const {
+        if (fits(bytes)) return;
+        throw std::runtime_error("The " + stage + " stage needs about " +
+                                 std::to_string((bytes >> 20) + 1) +
+                                 " MB, more than the memory limit of " +
+                                 std::to_string(m_limit >> 20) + " MB");
+    }
+};
+
+#endif
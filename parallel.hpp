@@ -0,0 +1,88 @@
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//! calls f(0), ..., f(n - 1) using the given number of threads,
+//! the calling thread takes part in the work. the first exception thrown by
+//! f stops the calls not yet started and is rethrown once all threads ended
+template <class F>
+void parallel_for(size_t n, size_t threads, F f) {
+    std::atomic<size_t> next(0);
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    auto worker = [&]() {
+        try {
+            for (size_t k = next++; k < n; k = next++) f(k);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if (!error) error = std::current_exception();
+            next = n;
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (size_t t = 1; t < threads; t++) pool.emplace_back(worker);
+    worker();
+    for (auto &t : pool) t.join();
+    if (error) std::rethrow_exception(error);
+}
+
+//! a queue of at most capacity items between the stages of a pipeline,
+//! push waits while it is full and pop while it is empty and not closed
+template <class T>
+class bounded_queue {
+    std::deque<T> m_items;
+    size_t m_capacity;
+    bool m_closed = false;
+    std::mutex m_mutex;
+    std::condition_variable m_not_full;
+    std::condition_variable m_not_empty;
+
+  public:
+    explicit bounded_queue(size_t capacity) : m_capacity(capacity) {}
+
+    //! appends x, dropped if the queue is closed
+    void push(T &&x) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_not_full.wait(lock, [&]() { return m_items.size() < m_capacity || m_closed; });
+        if (m_closed) return;
+        m_items.push_back(std::move(x));
+        m_not_empty.notify_one();
+    }
+
+    //! moves the first item to x, returns false if the queue is closed and
+    //! empty
+    bool pop(T &x) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_not_empty.wait(lock, [&]() { return !m_items.empty() || m_closed; });
+        if (m_items.empty()) return false;
+        x = std::move(m_items.front());
+        m_items.pop_front();
+        m_not_full.notify_one();
+        return true;
+    }
+
+    //! returns whether the queue is closed
+    bool closed() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_closed;
+    }
+
+    //! ends the queue, the items in it can still be popped
+    void close() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closed = true;
+        m_not_full.notify_all();
+        m_not_empty.notify_all();
+    }
+};
+
+#endif
@@ -0,0 +1,119 @@
+#!/bin/sh
+# Runs construction and inversion of the benchmark datasets, checks the
+# round trip with cmp and compares the wall time and peak RSS of every stage
+# with a baseline. Fails if a stage is slower or larger than the baseline by
+# more than THRESHOLD, e.g. 0.25 for 25%.
+#
+# usage: ./perf_check.sh [--update] [BASELINE]
+#
+# --update writes the measured stages to BASELINE (default
+# perf_baseline.json) instead of comparing. every dataset runs REPEAT times
+# (default 3) and the fastest run counts. differences below MIN_TIME seconds
+# (default 0.1) or MIN_RSS_KB (default 4096) are ignored as noise.
+#
+# the baseline is specific to the machine and the sdsl-lite it was built
+# with and is not part of the repository, measure it with --update before
+# the changes to check.
+set -e
+
+UPDATE=0
+if [ "$1" = --update ]; then
+    UPDATE=1
+    shift
+fi
+BASELINE=${1:-perf_baseline.json}
+if [ $UPDATE = 0 ] && [ ! -f "$BASELINE" ]; then
+    echo "No baseline $BASELINE, measure one on this machine with" \
+        "'make perf_baseline' before the changes to check" >&2
+    exit 1
+fi
+THRESHOLD=${THRESHOLD:-0.25}
+MIN_TIME=${MIN_TIME:-0.1}
+MIN_RSS_KB=${MIN_RSS_KB:-4096}
+REPEAT=${REPEAT:-3}
+WORK=perf_check.tmp
+
+mkdir -p "$WORK"
+RESULTS="$WORK/results.tsv"
+: > "$RESULTS"
+
+# appends dataset, tool, stage, wall_s and peak_rss_kb of a --stats file to
+# the results
+stages() {
+    sed -n 's/.*"name": "\([^"]*\)", "wall_s": \([^,]*\), "cpu_s": [^,]*, "peak_rss_kb": \([^,}]*\).*/\1\t\2\t\3/p' "$3" |
+        while read -r line; do printf "%s\t%s\t%s\n" "$1" "$2" "$line"; done >> "$RESULTS"
+}
+
+# runs dataset NAME from INPUT with window W and modulus P
+run() {
+    echo "== $1"
+    i=0
+    while [ $i -lt "$REPEAT" ]; do
+        ./tfm_index_construct.x -w "$3" -p "$4" -i "$2" -o "$WORK/$1.wg" \
+            --stats "$WORK/construct.json" > /dev/null
+        ./tfm_index_invert.x "$WORK/$1.wg" "$WORK/$1.untunneled" 1 \
+            "$WORK/invert.json"
+        cmp "$WORK/$1.untunneled" "$2"
+        stages "$1" construct "$WORK/construct.json"
+        stages "$1" invert "$WORK/invert.json"
+        i=$((i + 1))
+    done
+}
+
+run yeast data/yeast.raw 4 50
+./generate_collection.x -l 262144 -n 16 -o "$WORK/synthetic.txt"
+run synthetic "$WORK/synthetic.txt" 10 100
+
+# the fastest and smallest run of every stage, in the order of the stages
+MEASURED="$WORK/measured.tsv"
+awk -F '\t' '{
+    k = $1 "\t" $2 "\t" $3
+    if (!(k in wall)) { order[n++] = k; wall[k] = $4; rss[k] = $5 }
+    if ($4 < wall[k]) wall[k] = $4
+    if ($5 < rss[k]) rss[k] = $5
+} END {
+    for (i = 0; i < n; i++) print order[i] "\t" wall[order[i]] "\t" rss[order[i]]
+}' "$RESULTS" > "$MEASURED"
+
+if [ $UPDATE = 1 ]; then
+    awk -F '\t' 'BEGIN { print "{\n  \"stages\": [" } {
+        if (NR > 1) print ","
+        printf "    {\"dataset\": \"%s\", \"tool\": \"%s\", \"stage\": \"%s\", \"wall_s\": %s, \"peak_rss_kb\": %s}", $1, $2, $3, $4, $5
+    } END { print "\n  ]\n}" }' "$MEASURED" > "$BASELINE"
+    echo "Baseline written to $BASELINE"
+    rm -rf "$WORK"
+    exit 0
+fi
+
+sed -n 's/.*"dataset": "\([^"]*\)", "tool": "\([^"]*\)", "stage": "\([^"]*\)", "wall_s": \([^,]*\), "peak_rss_kb": \([^,}]*\).*/\1\t\2\t\3\t\4\t\5/p' \
+    "$BASELINE" > "$WORK/baseline.tsv"
+
+awk -F '\t' -v t="$THRESHOLD" -v min_time="$MIN_TIME" -v min_rss="$MIN_RSS_KB" '
+NR == FNR { k = $1 "\t" $2 "\t" $3; order[n++] = k; bwall[k] = $4; brss[k] = $5; next }
+{ k = $1 "\t" $2 "\t" $3; wall[k] = $4; rss[k] = $5 }
+END {
+    printf "%-10s %-10s %-14s %10s %10s %12s %12s\n", "dataset", "tool", "stage",
+           "base s", "s", "base RSS kB", "RSS kB"
+    for (i = 0; i < n; i++) {
+        k = order[i]
+        split(k, f, "\t")
+        if (!(k in wall)) {
+            printf "%-10s %-10s %-14s missing\n", f[1], f[2], f[3]
+            failed++
+            continue
+        }
+        status = ""
+        if (wall[k] > bwall[k] * (1 + t) && wall[k] - bwall[k] > min_time) status = status " time"
+        if (rss[k] > brss[k] * (1 + t) && rss[k] - brss[k] > min_rss) status = status " memory"
+        if (status != "") failed++
+        printf "%-10s %-10s %-14s %10.3f %10.3f %12d %12d%s\n", f[1], f[2], f[3],
+               bwall[k], wall[k], brss[k], rss[k], status == "" ? "" : "  REGRESSION:" status
+    }
+    if (failed) {
+        printf "%d stages regressed by more than %g%%\n", failed, t * 100
+        exit 1
+    }
+    print "No regressions."
+}' "$WORK/baseline.tsv" "$MEASURED"
+
+rm -rf "$WORK"
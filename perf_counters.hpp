@@ -0,0 +1,161 @@
+#ifndef PERF_COUNTERS_HPP
+#define PERF_COUNTERS_HPP
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+//! hardware counters of the process: cycles, instructions, last level cache
+//! misses, branch misses and dTLB misses, from perf_event_open.
+//!
+//! the counters count in user space only and are inherited by the threads
+//! created after open, a thread adds its counts when it is joined. events
+//! which cannot be opened, e.g. in a VM without a PMU or with a restrictive
+//! perf_event_paranoid, read as zero and are left out of the reports. the
+//! counts are scaled when the kernel multiplexes the counters.
+class perf_counters {
+  public:
+    static const size_t events = 5;
+    typedef std::array<uint64_t, events> values;
+
+    //! the names of the events in the order of values
+    static const char *name(size_t e) {
+        static const char *const names[events] = {
+            "cycles", "instructions", "llc_misses", "branch_misses", "dtlb_misses"
+        };
+        return names[e];
+    }
+
+    //! the counts of all calls of a code region
+    struct region {
+        std::string name;
+        uint64_t calls = 0;
+        values counts{};
+    };
+
+  private:
+    int m_fd[events] = {-1, -1, -1, -1, -1};
+    std::vector<region> m_regions;
+    std::mutex m_mutex;
+
+    static int open_event(uint32_t type, uint64_t config) {
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format =
+            PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+
+    perf_counters() {}
+
+  public:
+    perf_counters(const perf_counters &) = delete;
+    perf_counters &operator=(const perf_counters &) = delete;
+
+    ~perf_counters() {
+        for (int fd : m_fd) {
+            if (fd >= 0) close(fd);
+        }
+    }
+
+    //! the counters of the process
+    static perf_counters &global() {
+        static perf_counters counters;
+        return counters;
+    }
+
+    //! starts the events which are available, returns whether any is
+    bool open() {
+        if (available()) return true;
+        const uint64_t dtlb_miss = PERF_COUNT_HW_CACHE_DTLB |
+                                   (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                   (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        m_fd[0] = open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+        m_fd[1] = open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+        m_fd[2] = open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+        m_fd[3] = open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+        m_fd[4] = open_event(PERF_TYPE_HW_CACHE, dtlb_miss);
+        return available();
+    }
+
+    //! returns whether any event is counted
+    bool available() const {
+        for (int fd : m_fd) {
+            if (fd >= 0) return true;
+        }
+        return false;
+    }
+
+    //! returns whether event e is counted
+    bool has(size_t e) const { return m_fd[e] >= 0; }
+
+    //! returns the counts since open
+    values read() const {
+        values v{};
+        for (size_t e = 0; e < events; e++) {
+            uint64_t buf[3]; // value, time enabled, time running
+            if (m_fd[e] < 0 || ::read(m_fd[e], buf, sizeof(buf)) != sizeof(buf)) continue;
+            v[e] = (buf[2] == 0 || buf[2] >= buf[1])
+                       ? buf[0]
+                       : (uint64_t)((double)buf[0] * buf[1] / buf[2]);
+        }
+        return v;
+    }
+
+    //! adds the counts of a call of the code region name
+    void add(const std::string &name, const values &counts) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        size_t r = 0;
+        while (r < m_regions.size() && m_regions[r].name != name) r++;
+        if (r == m_regions.size()) {
+            m_regions.emplace_back();
+            m_regions.back().name = name;
+        }
+        m_regions[r].calls++;
+        for (size_t e = 0; e < events; e++) m_regions[r].counts[e] += counts[e];
+    }
+
+    //! returns the regions in the order of their first calls
+    std::vector<region> regions() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_regions;
+    }
+};
+
+//! adds the counts of its lifetime to the region name of the global
+//! counters, does nothing if they are not open. the threads which count
+//! towards the region must be joined before it ends
+class perf_scope {
+    const char *m_name;
+    bool m_on;
+    perf_counters::values m_start;
+
+  public:
+    perf_scope(const char *name)
+        : m_name(name), m_on(perf_counters::global().available()) {
+        if (m_on) m_start = perf_counters::global().read();
+    }
+
+    perf_scope(const perf_scope &) = delete;
+    perf_scope &operator=(const perf_scope &) = delete;
+
+    ~perf_scope() {
+        if (!m_on) return;
+        perf_counters::values v = perf_counters::global().read();
+        for (size_t e = 0; e < perf_counters::events; e++) v[e] -= m_start[e];
+        perf_counters::global().add(m_name, v);
+    }
+};
+
+#endif
@@ -0,0 +1,1011 @@
+#ifndef PFP_WG_HPP
+#define PFP_WG_HPP
+
+// the construction pipeline of tfm_index_construct: prefix-free parsing of
+// the text (pf_parse), BWT of the parse (compute_bwt), tunneling of its
+// de Bruijn graph (construct_tfm_index) and unparsing into the tunneled
+// index of the text (unparse). the functions are defined here, so the
+// header is included by a single translation unit of each program
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <sdsl/int_vector.hpp>
+#include <sdsl/io.hpp>
+#include <sdsl/wavelet_trees.hpp>
+#include <sstream>
+#include <stddef.h>
+#include <stdexcept>
+#include <stdlib.h>
+#include <string>
+#include <sys/types.h>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <semaphore.h>
+#include <errno.h>
+#include <assert.h>
+
+#include <sdsl/util.hpp>
+#include "tfm_index.hpp"
+#include "dbg_algorithms.hpp"
+#include "memory_governor.hpp"
+#include "parallel.hpp"
+#include "perf_counters.hpp"
+
+extern "C" {
+#include "gsacak.c"
+#include "utils.c"
+}
+// gsacak.c defines max as a macro, which would break std::max in the
+// headers included after this one
+#undef max
+
+using namespace std;
+using namespace sdsl;
+using namespace __gnu_cxx;
+
+// =============== algorithm limits ===================
+// maximum number of distinct words
+#define MAX_DISTINCT_WORDS (INT32_MAX - 1)
+// typedef uint32_t word_int_t;
+// maximum number of occurrences of a single word
+#define MAX_WORD_OCC (UINT32_MAX)
+// typedef uint32_t occ_int_t;
+
+// clang-format off
+uint8_t asc2dnacat[] = {
+    /*   0 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /*  16 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /*  32 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 3, 0, 0,
+           /*                                        -     */
+    /*  48 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /*  64 */ 0, 1, 2, 1, 2, 0, 0, 1, 2, 0, 0, 2, 0, 2, 2, 0,
+           /*    A  B  C  D        G  H        K     M  N  */
+    /*  80 */ 0, 0, 2, 2, 1, 0, 2, 2, 2, 2, 0, 0, 0, 0, 0, 0,
+           /*       R  S  T     V  W  X  Y */
+    /*  96 */ 0, 1, 2, 1, 2, 0, 0, 1, 2, 0, 0, 2, 0, 2, 2, 0,
+           /*    a  b  c  d        g  h        k     m  n  */
+    /* 112 */ 0, 0, 2, 2, 1, 0, 2, 2, 2, 2, 0, 0, 0, 0, 0, 0,
+           /*       r  s  t     v  w  x  y                 */
+    /* 128 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* 144 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* 160 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* 176 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* 192 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* 208 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* 224 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* 240 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+};
+// clang-format on
+
+struct word_stats {
+    string str;             // word
+    uint32_t occ;           // its number of occurences
+    uint32_t rank = 0;      // its rank
+};
+
+struct KR_window {
+    int wsize;
+    int *window;
+    int asize;
+    const uint64_t prime = 1999999973;
+    uint64_t hash;
+    uint64_t tot_char;
+    uint64_t asize_pot; // asize^(wsize-1) mod prime
+
+    KR_window(int w) : wsize(w) {
+        asize = 256;
+        asize_pot = 1;
+        for (int i = 1; i < wsize; i++)
+            asize_pot =
+                (asize_pot * asize) % prime; // ugly linear-time power algorithm
+        // alloc and clear window
+        window = new int[wsize];
+        reset();
+    }
+
+    void reset() {
+        for (int i = 0; i < wsize; i++)
+            window[i] = 0;
+        hash = tot_char = 0;
+    }
+
+    uint64_t addchar(int c) {
+        int k = tot_char++ % wsize;
+        // complex expression to avoid negative numbers
+        hash += (prime - (window[k] * asize_pot) % prime);  // remove window[k] contribution
+        hash = (asize * hash + c) % prime;                  //  add char i
+        window[k] = c;
+        return hash;
+    }
+
+    ~KR_window() { delete[] window; }
+};
+// -----------------------------------------------------------
+
+uint64_t kr_hash(string s) {
+    uint64_t hash = 0;
+    const uint64_t prime = 27162335252586509; // next prime (2**54 + 2**53 + 2**47 + 2**13)
+    for (size_t k = 0; k < s.size(); k++) {
+        int c = (unsigned char)s[k];
+        assert(c >= 0 && c < 256);
+        hash = (256 * hash + c) % prime; //  add char k
+    }
+    return hash;
+}
+
+// adds an occurrence of the word w with the given hash to the frequencies
+static void update_word_freq(uint64_t hash, const string &w, map<uint64_t, word_stats> &freq) {
+    if (freq.find(hash) == freq.end()) {
+        freq[hash].occ = 1; // new hash
+        freq[hash].str = w;
+    } else {
+        freq[hash].occ += 1; // known hash
+        if (freq[hash].occ <= 0) {
+            cerr << "Emergency exit! Maximum # of occurence of dictionary word "
+                    "(";
+            cerr << MAX_WORD_OCC << ") exceeded\n";
+            exit(1);
+        }
+        if (freq[hash].str != w) {
+            cerr << "Emergency exit! Hash collision for strings:\n";
+            cerr << freq[hash].str << "\n  vs\n" << w << endl;
+            exit(1);
+        }
+    }
+}
+
+static void save_update_word(string &w, unsigned int minsize, map<uint64_t, word_stats> &freq, vector<uint64_t> &parse, uint64_t &pos) {
+    assert(pos == 0 || w.size() > minsize);
+    if (w.size() <= minsize)
+        return;
+    // get the hash value and write it to the temporary parse file
+    uint64_t hash = kr_hash(w);
+    parse.push_back(hash);
+    update_word_freq(hash, w, freq);
+
+    // pos is the ending position+1 of the previous word and is updated here
+    if (pos == 0)
+        pos = w.size() - 1; // -1 is for the initial $ of the first word
+    else
+        pos += w.size() - minsize;
+    // keep only the overlapping part of the window
+    w.erase(0, w.size() - minsize);
+}
+
+// bytes of the frequencies and of the parse while it runs, checked against
+// the limit of the governor whenever a phrase is added
+struct parse_meter {
+    const memory_governor *governor = nullptr;
+    size_t phrases = 0;  // bytes of the distinct phrases
+    size_t dsize = 1;    // chars of the dictionary of the distinct phrases
+    size_t reserved = 0; // bytes of buffers between the threads
+    size_t peak = 0;
+
+    explicit parse_meter(const memory_governor *governor = nullptr) : governor(governor) {}
+
+    // records the phrase of len chars if it is a new one, freq grew with it
+    void add(bool is_new, size_t len, const vector<uint64_t> &parse) {
+        if (is_new) {
+            phrases += memory_governor::phrase_bytes(len);
+            dsize += len + 1;
+        }
+        size_t bytes = memory_governor::parse_bytes(phrases, parse.capacity()) + reserved;
+        if (bytes <= peak) return;
+        peak = bytes;
+        if (governor) governor->check("parse", bytes);
+    }
+};
+
+uint64_t process_file(istream &f, size_t w, size_t p, map<uint64_t, word_stats> &wordFreq, vector<uint64_t> &g_vec, parse_meter *meter = nullptr) {
+    uint64_t pos = 0;
+    string word("");
+    word.append(1, Dollar);
+    KR_window krw(w);
+    int c;
+    perf_scope counters("process_file");
+    while ((c = f.get()) != EOF) {
+        if (c <= Dollar) {
+            cerr << "Invalid char found in input file: no additional chars "
+                    "will be read\n";
+            break;
+        }
+        word.append(1, c);
+        uint64_t hash = krw.addchar(c);
+        if (hash % p == 0) {
+            size_t len = word.size(), words = wordFreq.size();
+            save_update_word(word, w, wordFreq, g_vec, pos);
+            if (meter) meter->add(wordFreq.size() > words, len, g_vec);
+        }
+    }
+    word.append(w, Dollar);
+    size_t len = word.size(), words = wordFreq.size();
+    save_update_word(word, w, wordFreq, g_vec, pos);
+    if (meter) meter->add(wordFreq.size() > words, len, g_vec);
+
+    return krw.tot_char;
+}
+
+// phrases and their hashes passed from the parsing to the dictionary stage
+struct phrase_batch {
+    vector<uint64_t> hashes;
+    vector<string> words;
+};
+
+// process_file as a pipeline of two threads: one reads the text, finds the
+// phrases and hashes them, the other inserts them into the dictionary and
+// appends them to the parse. the result is the same as of process_file
+uint64_t process_file_pipelined(istream &f, size_t w, size_t p, map<uint64_t, word_stats> &wordFreq, vector<uint64_t> &g_vec, parse_meter *meter = nullptr) {
+    const size_t batch_size = 1 << 12;
+    const size_t block_size = 1 << 16;
+    const size_t queued = 16;
+    bounded_queue<phrase_batch> phrases(queued);
+    // the queued batches and those of both threads, of phrases of the
+    // expected length w + p
+    if (meter) meter->reserved = (queued + 2) * batch_size * (8 + sizeof(string) + w + p) + block_size;
+    uint64_t tot_char = 0;
+    std::exception_ptr error;
+
+    perf_scope counters("process_file");
+    std::thread producer([&]() {
+        try {
+            KR_window krw(w);
+            string word(1, Dollar);
+            phrase_batch batch;
+            // as save_update_word
+            auto save_word = [&]() {
+                if (word.size() <= w) return;
+                batch.hashes.push_back(kr_hash(word));
+                batch.words.push_back(word);
+                word.erase(0, word.size() - w);
+                if (batch.hashes.size() == batch_size) {
+                    phrases.push(std::move(batch));
+                    batch = phrase_batch();
+                }
+            };
+            vector<char> block(block_size);
+            bool valid = true;
+            // the queue is closed early if the dictionary stage fails
+            while (valid && !phrases.closed() && f.read(block.data(), block_size).gcount() > 0) {
+                size_t n = f.gcount();
+                for (size_t i = 0; i < n; i++) {
+                    int c = (unsigned char)block[i];
+                    if (c <= Dollar) {
+                        cerr << "Invalid char found in input file: no additional chars "
+                                "will be read\n";
+                        valid = false;
+                        break;
+                    }
+                    word.append(1, c);
+                    if (krw.addchar(c) % p == 0) save_word();
+                }
+            }
+            word.append(w, Dollar);
+            save_word();
+            if (!batch.hashes.empty()) phrases.push(std::move(batch));
+            tot_char = krw.tot_char;
+        } catch (...) {
+            error = std::current_exception();
+        }
+        phrases.close();
+    });
+
+    phrase_batch batch;
+    try {
+        while (phrases.pop(batch)) {
+            for (size_t i = 0; i < batch.hashes.size(); i++) {
+                size_t words = wordFreq.size();
+                g_vec.push_back(batch.hashes[i]);
+                update_word_freq(batch.hashes[i], batch.words[i], wordFreq);
+                if (meter) meter->add(wordFreq.size() > words, batch.words[i].size(), g_vec);
+            }
+        }
+    } catch (...) {
+        phrases.close();
+        producer.join();
+        throw;
+    }
+    producer.join();
+    if (error) std::rethrow_exception(error);
+    return tot_char;
+}
+
+bool pstringCompare(const string *a, const string *b) { return *a <= *b; }
+
+void writeDictOcc(map<uint64_t, word_stats> &wfreq, vector<const string *> &sortedDict, vector<char> &dict) {
+    assert(sortedDict.size() == wfreq.size());
+    vector<uint32_t> vocc{};
+
+    uint32_t wrank = 1; // current word rank (1 based)
+    for (auto x : sortedDict) {
+        const char *word = (*x).data(); // current dictionary word
+        size_t len = (*x).size(); // offset and length of word
+        // assert(len > (size_t)arg.w);
+        for (size_t i = 0; i < len; i++) {
+            dict.push_back(word[i]);
+        }
+        dict.push_back(EndOfWord);
+
+        uint64_t hash = kr_hash(*x);
+        struct word_stats &wf = wfreq.at(hash);
+        assert(wf.occ > 0);
+        vocc.push_back(wf.occ);
+
+        assert(wf.rank == 0);
+        wf.rank = wrank++;
+    }
+    dict.push_back(EndOfDict);
+}
+
+// the phrases are found and inserted by two threads if threads > 1. if meter
+// is given, the parse throws once it needs more than the limit of its governor
+void calculate_word_frequencies(istream &in, size_t w, size_t p, map<uint64_t, word_stats> &wordFreq, vector<uint64_t> &parse, size_t *size, size_t threads = 1, parse_meter *meter = nullptr) {
+    try {
+        *size = threads > 1 ? process_file_pipelined(in, w, p, wordFreq, parse, meter)
+                            : process_file(in, w, p, wordFreq, parse, meter);
+    } catch (const std::bad_alloc &) {
+        cout << "Out of memory (parsing phase)... emergency exit\n";
+        die("bad alloc exception");
+    }
+
+
+    if (wordFreq.size() > MAX_DISTINCT_WORDS) {
+        cerr << "Emergency exit! The number of distinc words (" << wordFreq.size()
+             << ")\n";
+        cerr << "is larger than the current limit (" << MAX_DISTINCT_WORDS
+             << ")\n";
+        exit(1);
+    }
+}
+
+// the buffers are owned, so that they are freed also on an exception
+struct Dict {
+    std::unique_ptr<uint8_t[]> d; // the dictionary
+    std::unique_ptr<uint64_t[]> end; // end[i] is the index of the ending symbol of the i-th phrase
+    std::unique_ptr<uint8_t[]> prev; // prev[i] is the char preceding the last w chars of the i-th phrase
+    uint64_t dsize;  // dicionary size in symbols
+    uint64_t dwords; // the number of phrases of the dicionary
+};
+
+// binary search for x in an array a[0..n-1] that doesn't contain x
+// return the lowest position that is larger than x
+static long binsearch(uint_t x, uint_t a[], long n) {
+    long lo = 0;
+    long hi = n - 1;
+    while (hi > lo) {
+        assert(((lo == 0) || x > a[lo - 1]) && x < a[hi]);
+        int mid = (lo + hi) / 2;
+        assert(x != a[mid]); // x is not in a[]
+        if (x < a[mid])
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    assert(((hi == 0) || x > a[hi - 1]) && x < a[hi]);
+    return hi;
+}
+
+// return the length of the suffix starting in position p.
+// also write to seqid the id of the sequence containing that suffix
+// n is the # of distinct words in the dictionary, hence the length of eos[]
+static int_t getlen(uint_t p, uint_t eos[], long n, uint32_t *seqid) {
+    assert(p < eos[n - 1]);
+    *seqid = binsearch(p, eos, n);
+    assert(eos[*seqid] > p); // distance between position p and the next $
+    return eos[*seqid] - p;
+}
+
+struct SeqId {
+    uint32_t id;   // lex. id of the dictionary word to which the suffix belongs
+    int remaining; // remaining copies of the suffix to be considered
+    uint32_t *bwtpos;   // list of bwt positions of this dictionary word
+    uint8_t char2write; // char to be written (is the one preceeding the suffix)
+
+    // constructor
+    SeqId(uint32_t i, int r, uint32_t *b, int8_t c)
+        : id(i), remaining(r), bwtpos(b) {
+        char2write = c;
+    }
+
+    // advance to the next bwt position, return false if there are no more
+    // positions
+    bool next() {
+        remaining--;
+        bwtpos += 1;
+        return remaining > 0;
+    }
+};
+
+// tournament tree of losers merging the lists of bwt positions of several
+// dictionary words, the word with the smallest next bwt position wins
+struct loser_tree {
+    vector<SeqId> seq;
+    vector<uint32_t> node; // node[0] is the winner, node[i] the loser of match i
+
+    loser_tree(vector<SeqId> &s) : seq(s), node(s.size()) {
+        size_t k = seq.size();
+        vector<uint32_t> winner(2 * k);
+        for (size_t i = 0; i < k; i++) winner[k + i] = i;
+        for (size_t i = k - 1; i > 0; i--) {
+            uint32_t a = winner[2 * i];
+            uint32_t b = winner[2 * i + 1];
+            winner[i] = key(a) < key(b) ? a : b;
+            node[i] = key(a) < key(b) ? b : a;
+        }
+        node[0] = winner[1];
+    }
+
+    // next bwt position of the word s, exhausted words lose every match
+    uint32_t key(uint32_t s) const {
+        return seq[s].remaining > 0 ? *seq[s].bwtpos : UINT32_MAX;
+    }
+
+    bool empty() const { return key(node[0]) == UINT32_MAX; }
+
+    const SeqId &top() const { return seq[node[0]]; }
+
+    // advance the winner and replay the matches on its path to the root
+    void pop() {
+        uint32_t w = node[0];
+        seq[w].next();
+        for (size_t i = (w + seq.size()) / 2; i > 0; i /= 2) {
+            if (key(node[i]) < key(w)) std::swap(node[i], w);
+        }
+        node[0] = w;
+    }
+};
+
+// output sink of compute_L which only measures the size of the output. the
+// runs of L are counted only if rle is set, which needs the chars of the
+// merged phrases and so the merging of compute_L
+struct unparse_size {
+    static const bool writes = false;
+    bool rle = false;
+    size_t l = 0; // number of produced symbols of L (and bits of dout)
+    size_t f = 0; // number of produced bits of din
+    size_t r = 0; // number of runs of L
+    int last = -1;
+
+    void in(bool) { f++; }
+    void out(uint8_t c, bool) { l++; add_run(c); }
+    void run(uint8_t c, size_t n) { l += n; f += n; add_run(c); }
+
+    void add_run(uint8_t c) {
+        if (c != last) r++;
+        last = c;
+    }
+};
+
+// output sink of compute_L which fills a slice of preallocated din, dout and
+// of the buffer L holding the symbols L[q_start..q_end) of the output.
+// bits in machine words shared with the neighbouring slices are only recorded
+// and written by apply_fixups once all threads have finished. if rle is set,
+// the symbols are appended to runs instead of L
+struct unparse_slice {
+    static const bool writes = true;
+    uint8_t *L = nullptr;
+    bool rle = false;
+    rle_L::runs_type runs;
+    bit_vector *din;
+    bit_vector *dout;
+    size_t p, q;               // next position in din and in L, dout
+    size_t q_start;
+    size_t din_lo, din_hi;     // [din_lo, din_hi) are words owned by the slice
+    size_t dout_lo, dout_hi;   // [dout_lo, dout_hi) are words owned by the slice
+    vector<pair<size_t, bool>> din_fix, dout_fix;
+
+    unparse_slice(bit_vector &din, bit_vector &dout, size_t p_start, size_t p_end, size_t q_start, size_t q_end)
+        : din(&din), dout(&dout), p(p_start), q(q_start), q_start(q_start) {
+        din_lo = (p_start + 63) / 64 * 64;
+        din_hi = p_end / 64 * 64;
+        dout_lo = (q_start + 63) / 64 * 64;
+        dout_hi = q_end / 64 * 64;
+    }
+
+    void in(bool bit) {
+        if (p >= din_lo && p < din_hi) (*din)[p] = bit;
+        else din_fix.emplace_back(p, bit);
+        p++;
+    }
+
+    void add_run(uint8_t c, size_t n) {
+        if (!runs.empty() && runs.back().first == c) runs.back().second += n;
+        else runs.emplace_back(c, n);
+    }
+
+    void out(uint8_t c, bool bit) {
+        if (rle) add_run(c, 1);
+        else L[q - q_start] = c;
+        if (q >= dout_lo && q < dout_hi) (*dout)[q] = bit;
+        else dout_fix.emplace_back(q, bit);
+        q++;
+    }
+
+    void run(uint8_t c, size_t n) {
+        if (rle) {
+            // din and dout are preset to ones
+            add_run(c, n);
+            p += n;
+            q += n;
+            return;
+        }
+        for (size_t k = 0; k < n; k++) {
+            in(1);
+            out(c, 1);
+        }
+    }
+
+    void apply_fixups() {
+        for (auto &x : din_fix) (*din)[x.first] = x.second;
+        for (auto &x : dout_fix) (*dout)[x.first] = x.second;
+    }
+};
+
+// computes the part of L, din and dout of the text which corresponds
+// to the suffixes sa[lo..hi) of the dictionary, lo and hi have to be
+// boundaries of the groups of equal suffixes (see partition_sa)
+// parse_L is the decoded L of the parse-level index tfmp and occ[i] is
+// the number of occurrences of the i-th phrase in it
+template <class t_sink>
+void compute_L(long lo, long hi, size_t w, Dict &dict, uint32_t *ilist, tfm_index &tfmp, const int_vector<> &parse_L, const vector<uint32_t> &occ, uint_t *sa, int_t *lcp, t_sink &sink) {
+    uint8_t *d = dict.d.get();
+    long dwords = dict.dwords;
+    uint_t *eos = sa + 1;
+    tfm_index::scan_cursor cursor(tfmp);
+
+    long next;
+    uint32_t seqid;
+    for (long i = lo; i < hi; i = next) {
+        next = i + 1;
+        int_t suffixLen = getlen(sa[i], eos, dwords, &seqid);
+        if (suffixLen <= (int_t)w) continue;
+
+        if (sa[i] == 0 || d[sa[i] - 1] == EndOfWord) {
+            // ----- simple case: the suffix is a full word
+            uint32_t start = tfmp.C[seqid + 1];
+            uint32_t end = tfmp.C[seqid + 2];
+            for (uint32_t j = start; j < end; j++) {
+                sink.in(tfmp.din[j]);
+                if (tfmp.din[j] == 1) {
+                    uint32_t pos = cursor.dout_select(cursor.din_rank(j + 1));
+                    do {
+                        if (parse_L[pos] == 0) pos = 0;
+                        uint32_t act_phrase = parse_L[pos] - 1;
+                        sink.out(dict.prev[act_phrase], tfmp.dout[pos]);
+                    } while (tfmp.dout[++pos] != 1);
+                }
+            }
+        } else {
+            // ----- hard case: there can be a group of equal suffixes starting
+            // at i save seqid and the corresponding char
+            vector<uint32_t> id2merge(1, seqid);
+            vector<uint8_t> char2write(1, d[sa[i] - 1]);
+            while (next < hi && lcp[next] >= suffixLen) {
+                int_t nextsuffixLen = getlen(sa[next], eos, dwords, &seqid);
+                if (nextsuffixLen != suffixLen) break;
+                id2merge.push_back(seqid); // sequence to consider
+                char2write.push_back(d[sa[next] - 1]); // corresponding char
+                next++;
+            }
+
+            size_t numwords = id2merge.size(); // numwords dictionary words contain the same suffix
+            if (!t_sink::writes && !sink.rle) {
+                for (size_t i = 0; i < numwords; i++) {
+                    sink.run(0, occ[id2merge[i]]);
+                }
+                continue;
+            }
+
+            bool samechar = true;
+            for (size_t i = 1; (i < numwords) && samechar; i++) {
+                samechar = (char2write[i - 1] == char2write[i]);
+            }
+
+            if (samechar) {
+                for (size_t i = 0; i < numwords; i++) {
+                    sink.run(char2write[0], occ[id2merge[i]]);
+                }
+            } else {
+                // many words, many chars...
+                vector<SeqId> words;
+                for (size_t i = 0; i < numwords; i++) {
+                    uint32_t s = id2merge[i] + 1;
+                    words.push_back(SeqId(
+                        s, occ[id2merge[i]], ilist + (tfmp.C[s] - 1),
+                        char2write[i]
+                    ));
+                }
+                // merge the words by bwt position, write runs of equal chars
+                loser_tree tree(words);
+                uint8_t c = tree.top().char2write;
+                size_t n = 0;
+                for (; !tree.empty(); tree.pop()) {
+                    if (tree.top().char2write != c) {
+                        sink.run(c, n);
+                        c = tree.top().char2write;
+                        n = 0;
+                    }
+                    n++;
+                }
+                sink.run(c, n);
+            }
+        }
+    }
+}
+
+// splits the dictionary suffix array into at most n ranges, which can be
+// unparsed independently. a range can start at i only if sa[i] is not
+// a continuation of a group of equal suffixes, i.e. if lcp[i] < len(sa[i])
+vector<long> partition_sa(Dict &dict, size_t w, uint_t *sa, int_t *lcp, size_t n) {
+    long lo = dict.dwords + w + 1;
+    long hi = dict.dsize;
+    uint_t *eos = sa + 1;
+    uint32_t seqid;
+
+    vector<long> bounds(1, lo);
+    for (size_t k = 1; k < n; k++) {
+        long b = max(bounds.back(), lo + (long)((hi - lo) * k / n));
+        while (b < hi && lcp[b] >= getlen(sa[b], eos, dict.dwords, &seqid)) b++;
+        if (b > bounds.back() && b < hi) bounds.push_back(b);
+    }
+    bounds.push_back(hi);
+    return bounds;
+}
+
+void generate_ilist(uint32_t *ilist, const int_vector<> &parse_L, uint64_t dwords) {
+    vector<vector<uint32_t>> phrase_sources(dwords);
+    for (uint64_t i = 0; i < parse_L.size(); i++) {
+        uint32_t act_char = parse_L[i];
+        if (act_char == 0)
+            continue;
+        phrase_sources[act_char - 1].push_back(i);
+    }
+    uint64_t cnt = 0;
+    for (uint64_t i = 0; i < phrase_sources.size(); i++) {
+        for (int j = 0; j < (int)phrase_sources[i].size(); j++)
+            ilist[cnt++] = phrase_sources[i][j];
+    }
+}
+
+// a new file in $TMPDIR or /tmp with a unique name, removed with the object
+// also when construction fails
+class unique_tmp_file {
+    std::string m_name;
+
+  public:
+    explicit unique_tmp_file(const std::string &prefix) {
+        const char *dir = getenv("TMPDIR");
+        std::string name = std::string(dir && *dir ? dir : "/tmp") + "/" + prefix + ".XXXXXX";
+        vector<char> buf(name.begin(), name.end());
+        buf.push_back(0);
+        int fd = mkstemp(buf.data());
+        if (fd < 0) throw std::runtime_error("Cannot create temporary file " + name);
+        ::close(fd);
+        m_name = buf.data();
+    }
+
+    unique_tmp_file(const unique_tmp_file &) = delete;
+    unique_tmp_file &operator=(const unique_tmp_file &) = delete;
+
+    ~unique_tmp_file() { std::remove(m_name.c_str()); }
+
+    const std::string &name() const { return m_name; }
+};
+
+// the unparsed L is written either into memory or, if on_disk is set, into
+// a unique temporary file in windows of one range per thread. if rle is set, only
+// the runs of L are collected and the index gets a run-length encoded L. their
+// number is known after the measuring pass, which throws if they need more
+// than the limit of governor together with the reserved bytes of the buffers
+// alive outside of unparse
+tfm_index unparse(tfm_index &wg_parse, Dict &dict, size_t w, size_t size, size_t threads, bool on_disk, bool rle,
+                  const memory_governor &governor = memory_governor(), size_t reserved = 0) {
+    int_vector<> parse_L = wg_parse.decode_L();
+    // the buffers are owned, so that they are freed also on an exception
+    std::unique_ptr<uint32_t[]> ilist_buf(new uint32_t[parse_L.size() - 1]);
+    uint32_t *inverted_list = ilist_buf.get();
+    generate_ilist(inverted_list, parse_L, dict.dwords);
+    vector<uint32_t> occ(dict.dwords);
+    for (uint64_t i = 0; i < dict.dwords; i++) {
+        occ[i] = wg_parse.C[i + 2] - wg_parse.C[i + 1];
+    }
+
+    std::unique_ptr<uint32_t[]> sa_buf(new uint32_t[dict.dsize]);
+    std::unique_ptr<int32_t[]> lcp_buf(new int32_t[dict.dsize]);
+    uint32_t *sa_d = sa_buf.get();
+    int32_t *lcp_d = lcp_buf.get();
+    // separators s[i]=1 and with s[n-1]=0
+    // cout << dict.d << "\n" << dict.dsize << endl;;
+    gsacak(dict.d.get(), sa_d, lcp_d, NULL, dict.dsize);
+    dict.d[0] = 0;
+
+    // more ranges than threads to balance the work
+    vector<long> bounds = partition_sa(dict, w, sa_d, lcp_d, threads * 8);
+    size_t ranges = bounds.size() - 1;
+
+    // measure the output of each range and assign it a slice of the output
+    vector<unparse_size> sizes(ranges);
+    for (auto &s : sizes) s.rle = rle;
+    {
+        perf_scope counters("compute_L");
+        parallel_for(ranges, threads, [&](size_t r) {
+            compute_L(bounds[r], bounds[r + 1], w, dict, inverted_list, wg_parse, parse_L, occ, sa_d, lcp_d, sizes[r]);
+        });
+    }
+    vector<size_t> q_off(ranges + 1, 0);
+    vector<size_t> p_off(ranges + 1, 0);
+    size_t L_runs = 0; // runs at the ends of the ranges may still merge
+    for (size_t r = 0; r < ranges; r++) {
+        q_off[r + 1] = q_off[r] + sizes[r].l;
+        p_off[r + 1] = p_off[r] + sizes[r].f;
+        L_runs += sizes[r].r;
+    }
+    if (rle) {
+        governor.check("unparse", memory_governor::rle_bytes(size, dict.dsize, parse_L.size(), dict.dwords, L_runs) +
+                                      reserved);
+    }
+
+    bit_vector din(p_off[ranges] + 1, 1);
+    bit_vector dout(q_off[ranges] + 1, 1);
+
+    vector<unparse_slice> slices;
+    slices.reserve(ranges);
+    for (size_t r = 0; r < ranges; r++) {
+        slices.emplace_back(din, dout, p_off[r], p_off[r + 1], q_off[r], q_off[r + 1]);
+    }
+    auto unparse_range = [&](size_t r) {
+        compute_L(bounds[r], bounds[r + 1], w, dict, inverted_list, wg_parse, parse_L, occ, sa_d, lcp_d, slices[r]);
+    };
+
+    if (rle) {
+        for (auto &s : slices) s.rle = true;
+        {
+            perf_scope counters("compute_L");
+            parallel_for(ranges, threads, unparse_range);
+        }
+        for (auto &s : slices) s.apply_fixups();
+
+        rle_L::runs_type runs;
+        for (auto &s : slices) {
+            for (auto &x : s.runs) {
+                if (!runs.empty() && runs.back().first == x.first) runs.back().second += x.second;
+                else runs.push_back(x);
+            }
+            rle_L::runs_type().swap(s.runs);
+        }
+        ilist_buf.reset();
+        sa_buf.reset();
+        lcp_buf.reset();
+        util::clear(parse_L);
+        return tfm_index(size, runs, din, dout);
+    }
+
+    // L has width 0 as the integer wavelet tree of the index expects, with
+    // 8 bit entries so that the slices can write its bytes
+    int_vector<> L;
+    std::unique_ptr<unique_tmp_file> L_file;
+    int_vector_buffer<> L_buffer;
+    if (!on_disk) {
+        L = int_vector<>(q_off[ranges], 0, 8);
+        for (size_t r = 0; r < ranges; r++) {
+            slices[r].L = (uint8_t *)L.data() + q_off[r];
+        }
+        perf_scope counters("compute_L");
+        parallel_for(ranges, threads, unparse_range);
+    } else {
+        L_file.reset(new unique_tmp_file("pfp_wg_L"));
+        L_buffer = int_vector_buffer<>(L_file->name(), std::ios::out, 1 << 20, 8);
+        vector<vector<uint8_t>> window(threads);
+        for (size_t r0 = 0; r0 < ranges; r0 += threads) {
+            size_t n = min(threads, ranges - r0);
+            for (size_t k = 0; k < n; k++) {
+                window[k].resize(sizes[r0 + k].l);
+                slices[r0 + k].L = window[k].data();
+            }
+            {
+                perf_scope counters("compute_L");
+                parallel_for(n, threads, [&](size_t k) { unparse_range(r0 + k); });
+            }
+            for (size_t k = 0; k < n; k++) {
+                for (uint8_t c : window[k]) L_buffer.push_back(c);
+            }
+        }
+    }
+    for (auto &s : slices) s.apply_fixups();
+    ilist_buf.reset();
+    sa_buf.reset();
+    lcp_buf.reset();
+    util::clear(parse_L);
+
+    tfm_index tfm = on_disk ? tfm_index(size, L_buffer, din, dout)
+                            : tfm_index(size, L, din, dout);
+    return tfm;
+}
+vector<uint64_t> remapParse(map<uint64_t, word_stats> &wfreq, vector<uint64_t> &parse) {
+    vector<uint64_t> new_parse{};
+    new_parse.reserve(parse.size() + 1);
+
+    vector<uint32_t> occ(wfreq.size() + 1, 0); // ranks are zero based
+    for (uint64_t hash : parse) {
+        uint32_t rank = wfreq.at(hash).rank;
+        occ[rank]++;
+        new_parse.push_back(rank);
+    }
+    new_parse.push_back(0);
+    return new_parse;
+}
+
+Dict read_dictionary(vector<char> &dict, size_t w) {
+    size_t dsize = dict.size();
+    std::unique_ptr<uint8_t[]> d(new uint8_t[dsize]);
+    for (size_t i = 0; i < dsize; i++) {
+        d[i] = dict[i];
+    }
+
+    uint64_t dwords = 0;
+    for (size_t i = 0; i < dsize; i++) {
+        if (d[i] == EndOfWord)
+            dwords++;
+    }
+
+    std::unique_ptr<uint64_t[]> end(new uint64_t[dwords]);
+    int cnt = 0;
+    for (size_t i = 0; i < dsize; i++) {
+        if (d[i] == EndOfWord)
+            end[cnt++] = i;
+    }
+
+    // the Dollar starting the first phrase stands for the end of the text
+    std::unique_ptr<uint8_t[]> prev(new uint8_t[dwords]);
+    for (size_t i = 0; i < dwords; i++) {
+        uint64_t j = end[i] - w - 1;
+        prev[i] = (j == 0) ? 0 : d[j];
+    }
+
+    Dict res;
+    res.d = std::move(d);
+    res.end = std::move(end);
+    res.prev = std::move(prev);
+    res.dsize = dsize;
+    res.dwords = dwords;
+    return res;
+}
+
+void free_dictionary(Dict &dict) {
+    dict.d.reset();
+    dict.end.reset();
+    dict.prev.reset();
+}
+
+// sorts the phrases, sets their ranks and returns the dictionary
+vector<char> sort_dictionary(map<uint64_t, word_stats> &wordFreq) {
+    // create array of dictionary words
+    vector<const string *> dictArray;
+    uint64_t totDWord = wordFreq.size();
+    dictArray.reserve(totDWord);
+    for (auto &x : wordFreq) { dictArray.push_back(&x.second.str); }
+    assert(dictArray.size() == totDWord);
+    sort(dictArray.begin(), dictArray.end(), pstringCompare);
+    // write plain dictionary, also compute rank for each hash
+    vector<char> dictionary{};
+    writeDictOcc(wordFreq, dictArray, dictionary);
+    return dictionary;
+}
+
+void pf_parse(istream &in, size_t w, size_t p, vector<uint64_t> &parse, Dict &dict, size_t *size, size_t threads = 1) {
+    map<uint64_t, word_stats> wordFreq;
+    calculate_word_frequencies(in, w, p, wordFreq, parse, size, threads);
+    vector<char> dictionary = sort_dictionary(wordFreq);
+    dict = read_dictionary(dictionary, w);
+    parse = remapParse(wordFreq, parse);
+}
+
+void pf_parse(string &input, size_t w, size_t p, vector<uint64_t> &parse, Dict &dict, size_t *size) {
+    ifstream f(input);
+    if (!f.rdbuf()->is_open()) { // is_open does not work on igzstreams
+        perror(__func__);
+        throw std::runtime_error("Cannot open input file " + input);
+    }
+    pf_parse(f, w, p, parse, dict, size);
+}
+
+// if release is set, text is freed once copied into the text of gsacak
+vector<uint64_t> compute_bwt(vector<uint64_t> &text, bool release = false) {
+    uint64_t sigma = 0; // = 183416 + 1 + 2;
+    for (size_t i = 0; i < text.size(); i++) {
+        if (sigma < text[i])
+            sigma = text[i];
+    }
+    sigma += 1 + 2;
+    // +1 because {0,1,2} => 3, +2 because gsacak reserves 0 and 1
+    // so all number needs to be shifted
+
+    size_t n = text.size() + 2;
+    // appending 1 ends "words", appending 0 ends input to gsacak
+
+    vector<uint32_t> t(n);
+    for (size_t i = 0; i < text.size(); i++) t[i] = text[i]+2;
+    t[n-2] = 1; t[n-1] = 0;
+    if (release) vector<uint64_t>().swap(text);
+
+    vector<uint32_t> sa(n);
+    gsacak_int(t.data(), sa.data(), NULL, NULL, n, sigma);
+
+    vector<uint64_t> bwt{};
+    bwt.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+        if (sa[i] == 0) { bwt.push_back(0); continue; }
+        if (t[sa[i]-1] == 1) continue;
+        if (t[sa[i]-1] == 2) continue;
+        bwt.push_back(t[sa[i]-1]-2);
+    }
+    return bwt;
+}
+
+// min_dbg is set to the order k and the number of edges of the minimal
+// de Bruijn graph found for the BWT. if release is set, bwt is freed once
+// copied into L
+tfm_index construct_tfm_index(vector<uint64_t> &bwt, pair<size_t, size_t> *min_dbg,
+                              bool release = false) {
+    size_t n = bwt.size();
+    int_vector<> L(n, 0);
+    for (size_t i = 0; i < n; i++) L[i] = bwt[i];
+    if (release) vector<uint64_t>().swap(bwt);
+
+    wt_blcd_int<> wt_L;
+    construct_im(wt_L, L);
+    vector<uint64_t> C = tfm_index::get_C(L, wt_L.sigma);
+
+    bit_vector din;
+    *min_dbg = dbg_algorithms::find_min_dbg(wt_L, C, din);
+    bit_vector dout = din;
+    dbg_algorithms::mark_prefix_intervals(wt_L, C, dout, din);
+
+    tfm_index::size_type p = 0;
+    tfm_index::size_type q = 0;
+    size_t r = 0;
+    for (tfm_index::size_type i = 0; i < wt_L.size(); i++) {
+        if (din[i] == 1) {
+            L[r++] = wt_L[i];
+            dout[p++] = dout[i];
+        }
+        if (dout[i] == 1) {
+            din[q++] = din[i];
+        }
+    }
+    dout[p++] = 1;
+    din[q++] = 1;
+    dout.resize(p);
+    din.resize(q);
+    L.resize(r);
+
+    tfm_index tfm_index(n, L, din, dout);
+    return tfm_index;
+}
+
+void print_wg(tfm_index &wg) {
+    for (uint i=0; i < wg.L.size(); i++)
+        cout << wg.L[i] << " ";
+    cout << "\n";
+
+    cout << wg.dout << endl;
+    cout << wg.din << endl << endl;
+}
+
+#endif
@@ -0,0 +1,352 @@
+#include "pfp_wg_builder.hpp"
+
+#include <sys/stat.h>
+
+#include <cstdio>
+#include <fstream>
+#include <future>
+#include <stdexcept>
+#include <streambuf>
+#include <vector>
+
+#include "memory_governor.hpp"
+#include "pfp_wg.hpp"
+
+namespace {
+
+// reads a text from memory without copying it
+class memory_buf : public std::streambuf {
+  public:
+    memory_buf(const char *text, size_t len) {
+        char *b = const_cast<char *>(text);
+        setg(b, b, b + len);
+    }
+};
+
+// reads a text in blocks passed by a callback
+class reader_buf : public std::streambuf {
+    static const size_t block_size = 1 << 20;
+
+    const pfp_wg_builder::reader_type &m_read;
+    std::vector<char> m_block;
+
+  public:
+    reader_buf(const pfp_wg_builder::reader_type &read)
+        : m_read(read), m_block(block_size) {}
+
+  protected:
+    int_type underflow() override {
+        if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+        size_t n = m_read(m_block.data(), m_block.size());
+        if (n == 0) return traits_type::eof();
+        setg(m_block.data(), m_block.data(), m_block.data() + n);
+        return traits_type::to_int_type(*gptr());
+    }
+};
+
+// the checkpoints of a build, PREFIX.dict and PREFIX.parse written after
+// the parse, PREFIX.bwt after the bwt and PREFIX.ptfm, the compact index of
+// the parse, after the tunneling. every file starts with a header holding
+// the parameters of the build and the identity of its input and is renamed
+// into place once complete, so an existing file with matching parameters
+// and input is a finished stage. an input without identity, a stream or a
+// callback, matches no checkpoint
+class checkpoints {
+    static const uint64_t magic = 0x32504b4347575046; // "FPWGCKP2"
+
+    std::string m_prefix;
+    uint64_t m_w, m_p;
+    pfp_wg_builder::input_id m_input;
+
+  public:
+    // the stages after which checkpoints are written
+    enum stage { none, parse, bwt, tunnel };
+
+    uint64_t text_len = 0;
+    uint64_t parse_len = 0;
+
+    checkpoints(const std::string &prefix, size_t w, size_t p,
+                const pfp_wg_builder::input_id &input)
+        : m_prefix(prefix), m_w(w), m_p(p), m_input(input) {}
+
+    bool enabled() const { return !m_prefix.empty(); }
+
+    std::string file(const char *ext) const { return m_prefix + ext; }
+
+    // writes the checkpoint ext, the payload is written by f(out)
+    template <class F>
+    void write(const char *ext, F f) const {
+        std::string tmp = file(ext) + ".tmp";
+        {
+            std::ofstream out(tmp, std::ios::binary);
+            for (uint64_t x : {magic, m_w, m_p, m_input.kind, m_input.size, m_input.stamp,
+                               text_len, parse_len}) {
+                sdsl::write_member(x, out);
+            }
+            f(out);
+            if (!out.good()) throw std::runtime_error("Cannot write checkpoint " + tmp);
+        }
+        if (std::rename(tmp.c_str(), file(ext).c_str()) != 0) {
+            throw std::runtime_error("Cannot write checkpoint " + file(ext));
+        }
+    }
+
+    // reads the checkpoint ext with f(in), returns false if it does not
+    // exist, belongs to other parameters or another input or is truncated
+    template <class F>
+    bool read(const char *ext, F f) {
+        std::ifstream in(file(ext), std::ios::binary);
+        uint64_t h[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+        for (uint64_t &x : h) sdsl::read_member(x, in);
+        if (!in || h[0] != magic || h[1] != m_w || h[2] != m_p) return false;
+        if (m_input.kind == pfp_wg_builder::input_id::none || h[3] != m_input.kind ||
+            h[4] != m_input.size || h[5] != m_input.stamp) {
+            return false;
+        }
+        text_len = h[6];
+        parse_len = h[7];
+        try {
+            f(in);
+        } catch (const std::exception &) {
+            return false;
+        }
+        return in.good();
+    }
+
+    // reads the checkpoint ext of a stage to resume, found by last, with
+    // f(in), throws std::runtime_error if it cannot be read
+    template <class F>
+    void load(const char *ext, F f) {
+        if (!read(ext, f)) {
+            throw std::runtime_error("Cannot resume from checkpoint " + file(ext) +
+                                     ", it is truncated, remove it to build the stage again");
+        }
+    }
+
+    // removes the checkpoints, e.g. those of an earlier build
+    void clear() const {
+        for (const char *ext : {".dict", ".parse", ".bwt", ".ptfm"}) {
+            std::remove(file(ext).c_str());
+        }
+    }
+
+    bool exists(const char *ext) {
+        return read(ext, [](std::istream &) {});
+    }
+
+    // returns the last stage with checkpoints to resume from
+    stage last() {
+        if (!enabled() || !exists(".dict")) return none;
+        if (exists(".ptfm")) return tunnel;
+        if (exists(".bwt")) return bwt;
+        if (exists(".parse")) return parse;
+        return none;
+    }
+};
+
+void store_symbols(const vector<uint64_t> &v, std::ostream &out) {
+    int_vector<> iv(v.size());
+    for (size_t i = 0; i < v.size(); i++) iv[i] = v[i];
+    util::bit_compress(iv);
+    iv.serialize(out);
+}
+
+void load_symbols(vector<uint64_t> &v, std::istream &in) {
+    int_vector<> iv;
+    iv.load(in);
+    v.assign(iv.begin(), iv.end());
+}
+
+} // namespace
+
+tfm_index pfp_wg_builder::build(std::istream &in, const input_id &input) const {
+    run_stats none;
+    run_stats &stats = m_stats ? *m_stats : none;
+    memory_governor governor(m_params.memory_budget);
+    if (governor.limit() > 0) stats.set("memory_limit", governor.limit());
+
+    checkpoints ck(m_params.checkpoint, m_params.w, m_params.p, input);
+    checkpoints::stage resumed = m_params.resume ? ck.last() : checkpoints::none;
+    if (resumed == checkpoints::none && ck.enabled()) {
+        ck.clear();
+    } else if (resumed != checkpoints::none) {
+        const char *names[] = {"", "parse", "bwt", "tunnel"};
+        stats.set("resumed_after", names[resumed]);
+        if (m_params.verbose) cout << "resuming after " << names[resumed] << endl;
+    }
+
+    vector<uint64_t> parse{};
+    Dict dict;
+    size_t size;
+    size_t dict_bytes;
+    // with more threads, the dictionary is built from the sorted phrases
+    // while the parse is remapped to their ranks and its BWT is computed,
+    // if the limit leaves room for both copies of the dictionary
+    vector<char> dictionary;
+    // the future waits for the thread when destroyed, also on an exception
+    // in the meantime, and get rethrows one of read_dictionary
+    std::future<void> dict_builder;
+    if (resumed >= checkpoints::parse) {
+        vector<char> d;
+        ck.load(".dict", [&](std::istream &in) {
+            int_vector<8> iv;
+            iv.load(in);
+            d.assign(iv.begin(), iv.end());
+        });
+        dict = read_dictionary(d, m_params.w);
+        dict_bytes = memory_governor::dict_bytes(dict.dsize, dict.dwords);
+        size = ck.text_len;
+        if (resumed == checkpoints::parse) {
+            ck.load(".parse", [&](std::istream &in) { load_symbols(parse, in); });
+        }
+    } else {
+        stats.begin("parse");
+        map<uint64_t, word_stats> wordFreq;
+        parse_meter meter(&governor);
+        calculate_word_frequencies(in, m_params.w, m_params.p, wordFreq, parse, &size,
+                                   m_params.threads, &meter);
+        size_t bytes = max(meter.peak, memory_governor::remap_bytes(meter.phrases, parse.size(),
+                                                                    meter.dsize, wordFreq.size()));
+        stats.set("memory_parse", bytes);
+        governor.check("parse", bytes);
+        dictionary = sort_dictionary(wordFreq);
+        dict_bytes = memory_governor::dict_bytes(dictionary.size(), wordFreq.size());
+        size_t overlap = memory_governor::bwt_bytes(parse.size() + 1) + dict_bytes +
+                         dictionary.size();
+        if (m_params.threads > 1 && governor.fits(overlap)) {
+            dict_builder = std::async(std::launch::async, [&]() {
+                dict = read_dictionary(dictionary, m_params.w);
+                vector<char>().swap(dictionary);
+            });
+        } else {
+            dict = read_dictionary(dictionary, m_params.w);
+            vector<char>().swap(dictionary);
+        }
+        parse = remapParse(wordFreq, parse);
+        map<uint64_t, word_stats>().swap(wordFreq);
+        stats.end();
+        if (ck.enabled()) {
+            if (dict_builder.valid()) dict_builder.get();
+            ck.text_len = size;
+            ck.parse_len = parse.size();
+            ck.write(".dict", [&](std::ostream &out) {
+                int_vector<8> iv(dict.dsize);
+                for (size_t i = 0; i < dict.dsize; i++) iv[i] = dict.d[i];
+                iv.serialize(out);
+            });
+            ck.write(".parse", [&](std::ostream &out) { store_symbols(parse, out); });
+        }
+    }
+    size_t parse_len = resumed >= checkpoints::parse ? ck.parse_len : parse.size();
+    stats.set("text_len", size);
+    stats.set("parse_len", parse_len);
+
+    vector<uint64_t> bwt;
+    if (resumed == checkpoints::bwt) {
+        ck.load(".bwt", [&](std::istream &in) { load_symbols(bwt, in); });
+    } else if (resumed < checkpoints::bwt) {
+        size_t bytes = memory_governor::bwt_bytes(parse_len) + dict_bytes;
+        stats.set("memory_bwt", bytes);
+        governor.check("bwt", bytes);
+        stats.begin("bwt");
+        bwt = compute_bwt(parse, true);
+        stats.end();
+        if (ck.enabled()) {
+            ck.write(".bwt", [&](std::ostream &out) { store_symbols(bwt, out); });
+        }
+    }
+    vector<uint64_t>().swap(parse);
+    if (dict_builder.valid()) dict_builder.get();
+    stats.set("dsize", dict.dsize);
+    stats.set("dwords", dict.dwords);
+
+    tfm_index tfm;
+    if (resumed == checkpoints::tunnel) {
+        ck.load(".ptfm", [&](std::istream &in) { tfm.load(in); });
+    } else {
+        stats.set("bwt_len", bwt.size());
+        size_t bytes = memory_governor::tunnel_bytes(bwt.size(), dict.dwords) + dict_bytes;
+        stats.set("memory_tunnel", bytes);
+        governor.check("tunnel", bytes);
+        stats.begin("tunnel");
+        pair<size_t, size_t> min_dbg;
+        tfm = construct_tfm_index(bwt, &min_dbg, true);
+        stats.end();
+        stats.set("min_dbg_k", min_dbg.first);
+        stats.set("min_dbg_edges", min_dbg.second);
+        if (ck.enabled()) {
+            ck.write(".ptfm", [&](std::ostream &out) { tfm.serialize_compact(out); });
+        }
+    }
+    stats.set("parse_tunneled_L_len", tfm.L.size());
+    vector<uint64_t>().swap(bwt);
+    if (m_params.verbose) print_wg(tfm);
+
+    // only the runs of L are collected with rle, checked again by unparse
+    // once they are counted, an L on disk is the smaller variant otherwise.
+    // the dictionary and the index of the parse are alive during the unparse
+    size_t live = dict_bytes + size_in_bytes(tfm);
+    bool on_disk = m_params.on_disk ||
+                   (!m_params.rle && governor.unparse_on_disk(size, dict.dsize, parse_len, dict.dwords, live));
+    size_t bytes = (m_params.rle ? memory_governor::rle_bytes(size, dict.dsize, parse_len, dict.dwords, 0)
+                                 : memory_governor::unparse_bytes(size, dict.dsize, parse_len, dict.dwords,
+                                                                  on_disk)) +
+                   live;
+    stats.set("memory_unparse", bytes);
+    stats.set("unparse_on_disk", on_disk);
+    governor.check("unparse", bytes);
+    if (m_params.verbose && on_disk && !m_params.on_disk) {
+        cout << "keeping the unparsed L on disk to fit the memory limit" << endl;
+    }
+    stats.begin("unparse");
+    tfm_index unparsed =
+        unparse(tfm, dict, m_params.w, size, m_params.threads, on_disk, m_params.rle, governor, live);
+    stats.end();
+    stats.set("tunneled_L_len", unparsed.L.size());
+    if (unparsed.L.rle()) {
+        stats.set("L_runs", unparsed.L.runs());
+        if (m_params.verbose) cout << "runs: " << unparsed.L.runs() << endl;
+    }
+    free_dictionary(dict);
+    return unparsed;
+}
+
+tfm_index pfp_wg_builder::build(std::istream &in) const {
+    return build(in, input_id());
+}
+
+tfm_index pfp_wg_builder::build(const char *text, size_t len) const {
+    memory_buf buf(text, len);
+    std::istream in(&buf);
+    // a memory buffer is identified by its FNV-1a hash
+    input_id input;
+    if (!m_params.checkpoint.empty()) {
+        input.kind = input_id::memory;
+        input.size = len;
+        input.stamp = 0xcbf29ce484222325;
+        for (size_t i = 0; i < len; i++) {
+            input.stamp = (input.stamp ^ (uint8_t)text[i]) * 0x100000001b3;
+        }
+    }
+    return build(in, input);
+}
+
+tfm_index pfp_wg_builder::build(const reader_type &read) const {
+    reader_buf buf(read);
+    std::istream in(&buf);
+    return build(in, input_id());
+}
+
+tfm_index pfp_wg_builder::build_file(const std::string &filename) const {
+    std::ifstream in(filename);
+    struct stat st;
+    if (!in.rdbuf()->is_open() || stat(filename.c_str(), &st) != 0) {
+        throw std::runtime_error("Cannot open input file " + filename);
+    }
+    // a file is identified by its size and modification time
+    input_id input;
+    input.kind = input_id::file;
+    input.size = st.st_size;
+    input.stamp = (uint64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    return build(in, input);
+}
@@ -0,0 +1,90 @@
+#ifndef PFP_WG_BUILDER_HPP
+#define PFP_WG_BUILDER_HPP
+
+#include <cstddef>
+#include <functional>
+#include <istream>
+#include <string>
+
+#include "stats.hpp"
+#include "tfm_index.hpp"
+
+//! parameters of the construction
+struct pfp_wg_params {
+    size_t w = 10;            // sliding window size
+    size_t p = 100;           // modulus for establishing stopping w-tuples
+    size_t threads = 1;       // threads, more than one also pipeline the parse
+    size_t memory_budget = 0; // bytes, 0 for no limit
+    bool on_disk = false;     // keep the unparsed L on disk
+    bool rle = false;         // run-length encode the unparsed L
+    bool verbose = false;     // print the index of the parse and progress
+    std::string checkpoint;   // prefix of the checkpoint files, empty for none
+    bool resume = false;      // skip the stages with checkpoints of the same input
+};
+
+//! builds the tunneled FM-index of a text by prefix-free parsing, the
+//! pipeline of tfm_index_construct.x as a library, libpfpwg.a:
+//!
+//!     pfp_wg_params params;
+//!     params.threads = 4;
+//!     tfm_index tfm = pfp_wg_builder(params).build(text, len);
+//!
+//! the text is read from a memory buffer, a stream, a file or a callback
+//! which fills a buffer of the given size and returns the number of chars
+//! written to it, 0 at the end of the text. the bytes 0, 1 and 2 delimit the
+//! phrases, the text ends before the first of them.
+//!
+//! if a memory budget is given, a memory_governor estimates the peak of
+//! each stage from the sizes of the earlier ones. the unparsed L is kept on
+//! disk and the dictionary is read after the parse instead of alongside the
+//! BWT when they do not fit otherwise, and std::runtime_error is thrown
+//! before a stage which does not fit at all. the parse and the runs of a
+//! run-length encoded L are checked while they are counted, the parse
+//! throws once its phrases exceed the budget. if run_stats are given, the
+//! stages parse, bwt, tunnel and unparse, the sizes of the parse and the
+//! estimates are recorded in them.
+class pfp_wg_builder {
+  public:
+    typedef std::function<size_t(char *, size_t)> reader_type;
+
+    //! identifies the input of checkpoints: a file by its size and
+    //! modification time, a memory buffer by its length and hash
+    struct input_id {
+        enum : uint64_t { none = 0, file = 1, memory = 2 };
+        uint64_t kind = none;
+        uint64_t size = 0;
+        uint64_t stamp = 0;
+    };
+
+  private:
+    pfp_wg_params m_params;
+    run_stats *m_stats;
+
+    tfm_index build(std::istream &in, const input_id &input) const;
+
+  public:
+    pfp_wg_builder(const pfp_wg_params &params = pfp_wg_params(),
+                   run_stats *stats = nullptr)
+        : m_params(params), m_stats(stats) {}
+
+    const pfp_wg_params &params() const { return m_params; }
+
+    //! builds the index of the text read from in
+    tfm_index build(std::istream &in) const;
+
+    //! builds the index of text[0..len)
+    tfm_index build(const char *text, size_t len) const;
+
+    tfm_index build(const std::string &text) const {
+        return build(text.data(), text.size());
+    }
+
+    //! builds the index of the text passed by read
+    tfm_index build(const reader_type &read) const;
+
+    //! builds the index of the text in a file, throws std::runtime_error if
+    //! it cannot be opened
+    tfm_index build_file(const std::string &filename) const;
+};
+
+#endif
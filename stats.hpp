@@ -0,0 +1,172 @@
+#ifndef STATS_HPP
+#define STATS_HPP
+
+#include <sys/resource.h>
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "perf_counters.hpp"
+
+//! per-stage wall and cpu time, peak resident set size and allocated bytes
+//! of a run, together with named sizes, written as JSON by write_json.
+//!
+//! the hardware counters of perf_counters are opened when the statistics
+//! are enabled and reported for every stage and for the code regions
+//! counted with perf_scope, if they are available.
+//!
+//! the peak RSS of a stage is measured by resetting the high-water mark of
+//! the process at its start, which needs Linux; otherwise the peak since
+//! the start of the process is reported. allocated bytes are counted only if
+//! the program passes a counter, e.g. one updated by its operator new while
+//! the statistics are enabled
+class run_stats {
+    struct stage {
+        std::string name;
+        double wall_s = 0;
+        double cpu_s = 0;
+        uint64_t peak_rss_kb = 0;
+        uint64_t allocated_bytes = 0;
+        perf_counters::values counters{};
+    };
+
+    bool m_enabled = false;
+    const std::atomic<uint64_t> *m_allocated = nullptr;
+    std::vector<stage> m_stages;
+    std::vector<std::pair<std::string, std::string>> m_values;
+
+    std::chrono::steady_clock::time_point m_wall;
+    double m_cpu = 0;
+    uint64_t m_alloc = 0;
+    perf_counters::values m_counters{};
+
+    static double cpu_seconds() {
+        timespec ts;
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+    }
+
+    static void reset_peak_rss() {
+        std::ofstream out("/proc/self/clear_refs");
+        if (out) out << "5";
+    }
+
+    static uint64_t peak_rss_kb() {
+        std::ifstream in("/proc/self/status");
+        for (std::string line; std::getline(in, line);) {
+            if (line.compare(0, 6, "VmHWM:") == 0) return std::stoull(line.substr(6));
+        }
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_maxrss;
+    }
+
+    static std::string quote(const std::string &s) {
+        std::string q = "\"";
+        for (char c : s) {
+            if (c == '"' || c == '\\') q += '\\';
+            if ((unsigned char)c >= 0x20) q += c;
+        }
+        return q + "\"";
+    }
+
+    // the available counters as JSON members
+    static std::string counters_json(const perf_counters::values &v) {
+        std::string json;
+        for (size_t e = 0; e < perf_counters::events; e++) {
+            if (perf_counters::global().has(e)) {
+                json += std::string(", \"") + perf_counters::name(e) + "\": " +
+                        std::to_string(v[e]);
+            }
+        }
+        return json;
+    }
+
+  public:
+    run_stats(bool enabled = false, const std::atomic<uint64_t> *allocated = nullptr)
+        : m_enabled(enabled), m_allocated(allocated) {
+        if (m_enabled) perf_counters::global().open();
+    }
+
+    bool enabled() const { return m_enabled; }
+
+    //! starts measuring the stage name
+    void begin(const std::string &name) {
+        if (!m_enabled) return;
+        m_stages.emplace_back();
+        m_stages.back().name = name;
+        reset_peak_rss();
+        m_alloc = m_allocated ? m_allocated->load() : 0;
+        m_counters = perf_counters::global().read();
+        m_cpu = cpu_seconds();
+        m_wall = std::chrono::steady_clock::now();
+    }
+
+    //! ends the stage started last
+    void end() {
+        if (!m_enabled) return;
+        std::chrono::duration<double> wall = std::chrono::steady_clock::now() - m_wall;
+        stage &s = m_stages.back();
+        s.wall_s = wall.count();
+        s.cpu_s = cpu_seconds() - m_cpu;
+        s.peak_rss_kb = peak_rss_kb();
+        s.allocated_bytes = m_allocated ? m_allocated->load() - m_alloc : 0;
+        s.counters = perf_counters::global().read();
+        for (size_t e = 0; e < perf_counters::events; e++) s.counters[e] -= m_counters[e];
+    }
+
+    //! records a named value
+    void set(const std::string &key, uint64_t value) {
+        if (m_enabled) m_values.emplace_back(key, std::to_string(value));
+    }
+
+    void set(const std::string &key, const std::string &value) {
+        if (m_enabled) m_values.emplace_back(key, quote(value));
+    }
+
+    //! writes the values and stages as a JSON object, returns false on failure
+    bool write_json(const std::string &file) const {
+        std::ofstream out(file);
+        double wall = 0, cpu = 0;
+        uint64_t rss = 0;
+        out << "{\n";
+        for (auto &v : m_values) out << "  " << quote(v.first) << ": " << v.second << ",\n";
+        out << "  \"stages\": [\n";
+        for (size_t i = 0; i < m_stages.size(); i++) {
+            const stage &s = m_stages[i];
+            out << "    {\"name\": " << quote(s.name) << ", \"wall_s\": " << s.wall_s
+                << ", \"cpu_s\": " << s.cpu_s << ", \"peak_rss_kb\": " << s.peak_rss_kb
+                << ", \"allocated_bytes\": " << s.allocated_bytes
+                << counters_json(s.counters) << "}"
+                << (i + 1 < m_stages.size() ? "," : "") << "\n";
+            wall += s.wall_s;
+            cpu += s.cpu_s;
+            rss = std::max(rss, s.peak_rss_kb);
+        }
+        out << "  ],\n";
+        auto regions = perf_counters::global().regions();
+        if (!regions.empty()) {
+            out << "  \"regions\": [\n";
+            for (size_t i = 0; i < regions.size(); i++) {
+                out << "    {\"name\": " << quote(regions[i].name)
+                    << ", \"calls\": " << regions[i].calls
+                    << counters_json(regions[i].counts) << "}"
+                    << (i + 1 < regions.size() ? "," : "") << "\n";
+            }
+            out << "  ],\n";
+        }
+        out << "  \"total\": {\"wall_s\": " << wall << ", \"cpu_s\": " << cpu
+            << ", \"peak_rss_kb\": " << rss << "}\n";
+        out << "}\n";
+        return out.good();
+    }
+};
+
+#endif
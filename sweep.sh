@@ -0,0 +1,52 @@
+#!/bin/sh
+# Runs construction and inversion of synthetic collections of growing size
+# and records the time and memory of every stage.
+#
+# usage: ./sweep.sh [OUTDIR] [SIZE_MB ...]
+#
+# every size gets OUTDIR/construct_SIZE.json and OUTDIR/invert_SIZE.json as
+# written by --stats, and a line per stage in OUTDIR/summary.tsv. the inputs
+# have VARIANTS variants (default 16) of a base genome of SIZE_MB / VARIANTS
+# MB and are deleted after each size unless KEEP=1. W, P, THREADS, SNP,
+# INDEL and SEED set the other parameters.
+set -e
+
+OUTDIR=${1:-sweep}
+[ $# -gt 0 ] && shift
+SIZES=${*:-10 100 1000 10000}
+
+VARIANTS=${VARIANTS:-16}
+W=${W:-10}
+P=${P:-100}
+THREADS=${THREADS:-1}
+SNP=${SNP:-0.001}
+INDEL=${INDEL:-0.0001}
+SEED=${SEED:-42}
+
+mkdir -p "$OUTDIR"
+SUMMARY="$OUTDIR/summary.tsv"
+printf "size_mb\ttool\tstage\twall_s\tcpu_s\tpeak_rss_kb\n" > "$SUMMARY"
+
+# appends the stages of a --stats file to the summary
+summarize() {
+    sed -n 's/.*"name": "\([^"]*\)", "wall_s": \([^,]*\), "cpu_s": \([^,]*\), "peak_rss_kb": \([^,}]*\).*/\1\t\2\t\3\t\4/p' "$3" |
+        while read -r line; do printf "%s\t%s\t%s\n" "$1" "$2" "$line"; done >> "$SUMMARY"
+}
+
+for MB in $SIZES; do
+    TEXT="$OUTDIR/synthetic_$MB.txt"
+    LEN=$((MB * 1048576 / VARIANTS))
+    echo "== $MB MB: $VARIANTS variants of $LEN chars"
+    ./generate_collection.x -l "$LEN" -n "$VARIANTS" -s "$SNP" -d "$INDEL" \
+        -r "$SEED" -o "$TEXT"
+    ./tfm_index_construct.x -w "$W" -p "$P" -t "$THREADS" -i "$TEXT" \
+        -o "$TEXT.wg" --stats "$OUTDIR/construct_$MB.json"
+    ./tfm_index_invert.x "$TEXT.wg" "$TEXT.untunneled" "$THREADS" \
+        "$OUTDIR/invert_$MB.json"
+    cmp "$TEXT" "$TEXT.untunneled"
+    summarize "$MB" construct "$OUTDIR/construct_$MB.json"
+    summarize "$MB" invert "$OUTDIR/invert_$MB.json"
+    [ "${KEEP:-0}" = 1 ] || rm -f "$TEXT" "$TEXT".*
+done
+
+cat "$SUMMARY"
@@ -0,0 +1,111 @@
+#ifndef SYNTHETIC_HPP
+#define SYNTHETIC_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <ostream>
+#include <random>
+#include <string>
+
+//! parameters of a synthetic repetitive collection
+struct synthetic_params {
+    uint64_t length = 1 << 20;  // of the base genome
+    uint64_t variants = 16;
+    double snp_rate = 0.001;    // substitutions per base
+    double indel_rate = 0.0001; // insertions and deletions per base
+    uint64_t max_indel = 10;    // longest insertion or deletion
+    std::string alphabet = "ACGT";
+    uint64_t seed = 42;
+};
+
+//! a collection of variants of a random base genome, e.g. for scaling
+//! benchmarks.
+//!
+//! every variant is a copy of the base with substitutions, insertions and
+//! deletions at the given rates, the variants are concatenated. the output
+//! depends only on the parameters: the base and every variant are drawn from
+//! their own mt19937_64 seeded from the seed, whose sequence is fixed by the
+//! standard, and no std distributions are used
+class synthetic_collection {
+    synthetic_params m_params;
+    std::string m_base;
+
+    // a value in [0, 1) from 53 random bits
+    static double uniform(std::mt19937_64 &rng) {
+        return (rng() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    char random_char(std::mt19937_64 &rng) const {
+        return m_params.alphabet[rng() % m_params.alphabet.size()];
+    }
+
+    // appends variant k to buf and passes buf to flush when it is full
+    template <class t_flush>
+    void variant(uint64_t k, std::string &buf, t_flush &flush) const {
+        static const size_t buf_size = 1 << 20;
+        std::mt19937_64 rng(m_params.seed + k + 1);
+        size_t sigma = m_params.alphabet.size();
+        double snp = m_params.snp_rate;
+        double indel = snp + m_params.indel_rate;
+        for (uint64_t i = 0; i < m_base.size(); i++) {
+            char c = m_base[i];
+            double u = uniform(rng);
+            if (u < snp && sigma > 1) {
+                // one of the other characters
+                size_t j = m_params.alphabet.find(c);
+                c = m_params.alphabet[(j + 1 + rng() % (sigma - 1)) % sigma];
+            } else if (u < indel) {
+                uint64_t len = 1 + rng() % m_params.max_indel;
+                if (rng() & 1) {
+                    for (uint64_t j = 0; j < len; j++) buf += random_char(rng);
+                } else {
+                    i += len - 1;
+                    continue;
+                }
+            }
+            buf += c;
+            if (buf.size() >= buf_size) flush(buf);
+        }
+    }
+
+  public:
+    synthetic_collection(const synthetic_params &params) : m_params(params) {
+        m_params.max_indel = std::max(m_params.max_indel, (uint64_t)1);
+        if (m_params.alphabet.empty()) m_params.alphabet = "ACGT";
+        std::mt19937_64 rng(m_params.seed);
+        m_base.resize(m_params.length);
+        for (auto &c : m_base) c = random_char(rng);
+    }
+
+    const std::string &base() const { return m_base; }
+
+    //! passes the collection in pieces to flush, which takes a
+    //! std::string & and clears it
+    template <class t_flush>
+    void generate(t_flush flush) const {
+        std::string buf;
+        for (uint64_t k = 0; k < m_params.variants; k++) variant(k, buf, flush);
+        if (!buf.empty()) flush(buf);
+    }
+
+    //! writes the collection to out
+    void write(std::ostream &out) const {
+        generate([&](std::string &buf) {
+            out.write(buf.data(), buf.size());
+            buf.clear();
+        });
+    }
+
+    //! returns the collection
+    std::string str() const {
+        std::string text;
+        text.reserve(m_params.length * m_params.variants);
+        generate([&](std::string &buf) {
+            text += buf;
+            buf.clear();
+        });
+        return text;
+    }
+};
+
+#endif
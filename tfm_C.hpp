@@ -0,0 +1,110 @@
+#ifndef TFM_C_HPP
+#define TFM_C_HPP
+
+#include <sdsl/io.hpp>
+#include <sdsl/sd_vector.hpp>
+#include <sdsl/util.hpp>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+//! the C array of a tfm_index, C[c] is the number of symbols smaller than c.
+//!
+//! for byte alphabets C is a plain array of at most 257 words, which stays
+//! in L1. for larger alphabets, e.g. the phrases of the parse, the values
+//! C[c] + c, which are strictly increasing, are stored in an sd_vector and
+//! C[c] is found by select.
+class tfm_C {
+  public:
+    typedef uint64_t size_type;
+
+    static const size_type max_small_size = 257;
+
+  private:
+    bool m_small = true;
+    std::vector<size_type> m_array;
+    sdsl::sd_vector<> m_sd;
+    sdsl::sd_vector<>::select_1_type m_sd_select;
+    size_type m_size = 0;
+
+  public:
+    tfm_C() {};
+
+    tfm_C(const std::vector<size_type> &C) : m_size(C.size()) {
+        m_small = C.size() <= max_small_size;
+        if (m_small) {
+            m_array = C;
+            return;
+        }
+        std::vector<size_type> pos(C.size());
+        for (size_type c = 0; c < C.size(); c++) pos[c] = C[c] + c;
+        m_sd = sdsl::sd_vector<>(pos.begin(), pos.end());
+        sdsl::util::init_support(m_sd_select, &m_sd);
+    }
+
+    tfm_C(const tfm_C &other) { *this = other; }
+
+    tfm_C &operator=(const tfm_C &other) {
+        if (this != &other) {
+            m_small = other.m_small;
+            m_array = other.m_array;
+            m_sd = other.m_sd;
+            m_size = other.m_size;
+            sdsl::util::init_support(m_sd_select, &m_sd);
+        }
+        return *this;
+    }
+
+    size_type size() const { return m_size; }
+
+    size_type operator[](size_type c) const {
+        return m_small ? m_array[c] : m_sd_select(c + 1) - c;
+    }
+
+    //! prefetches C[c] of a plain array
+    void prefetch(size_type c) const {
+        if (m_small) __builtin_prefetch(m_array.data() + c);
+    }
+
+    //! returns C as a plain array
+    std::vector<size_type> to_vector() const {
+        std::vector<size_type> C(m_size);
+        for (size_type c = 0; c < m_size; c++) C[c] = (*this)[c];
+        return C;
+    }
+
+    //! serializes opbject
+    size_type serialize(
+        std::ostream &out, sdsl::structure_tree_node *v, std::string name
+    ) const {
+
+        sdsl::structure_tree_node *child = sdsl::structure_tree::add_child(
+            v, name, sdsl::util::class_name(*this)
+        );
+        size_type written_bytes = 0;
+        written_bytes += sdsl::write_member(m_small, out, child, "small");
+        written_bytes += sdsl::write_member(m_size, out, child, "size");
+        if (m_small) {
+            written_bytes += sdsl::serialize(m_array, out, child, "array");
+        } else {
+            written_bytes += m_sd.serialize(out, child, "sd");
+        }
+        sdsl::structure_tree::add_size(child, written_bytes);
+        return written_bytes;
+    };
+
+    //! loads a serialized object
+    void load(std::istream &in) {
+        sdsl::read_member(m_small, in);
+        sdsl::read_member(m_size, in);
+        if (m_small) {
+            sdsl::load(m_array, in);
+        } else {
+            m_sd.load(in);
+            sdsl::util::init_support(m_sd_select, &m_sd);
+        }
+    };
+};
+
+#endif
@@ -0,0 +1,258 @@
+#ifndef TFM_L_HPP
+#define TFM_L_HPP
+
+#include <sdsl/int_vector.hpp>
+#include <sdsl/io.hpp>
+#include <sdsl/sd_vector.hpp>
+#include <sdsl/util.hpp>
+#include <sdsl/wavelet_trees.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+//! a run-length encoded L, its size depends on the number of runs r.
+//!
+//! heads holds the symbol of every run, starts marks the first position of
+//! every run in L and sorted marks the first position of every run in the
+//! runs stably sorted by their symbols, i.e. C[c] plus the total length of
+//! the previous runs of c. a rank is found from the run containing the
+//! position and the number of runs of the same symbol before it.
+class rle_L {
+  public:
+    typedef sdsl::int_vector<>::size_type size_type;
+    typedef sdsl::wt_blcd_int<>::value_type value_type;
+    typedef std::vector<std::pair<uint8_t, uint64_t>> runs_type;
+
+  private:
+    size_type m_size = 0;
+    sdsl::wt_blcd_int<> m_heads;
+    sdsl::sd_vector<> m_starts; // and a one at m_size
+    sdsl::sd_vector<>::rank_1_type m_starts_rank;
+    sdsl::sd_vector<>::select_1_type m_starts_select;
+    sdsl::sd_vector<> m_sorted; // and a one at m_size
+    sdsl::sd_vector<>::rank_1_type m_sorted_rank;
+    sdsl::sd_vector<>::select_1_type m_sorted_select;
+    std::vector<size_type> m_C;     // symbols smaller than c
+    std::vector<size_type> m_run_C; // runs of symbols smaller than c
+
+    void init_supports() {
+        sdsl::util::init_support(m_starts_rank, &m_starts);
+        sdsl::util::init_support(m_starts_select, &m_starts);
+        sdsl::util::init_support(m_sorted_rank, &m_sorted);
+        sdsl::util::init_support(m_sorted_select, &m_sorted);
+    }
+
+    //! returns the first position of the j-th run of c, counted from 0,
+    //! in the runs sorted by symbol
+    size_type sorted_start(value_type c, size_type j) const {
+        return m_sorted_select(m_run_C[c] + j + 1);
+    }
+
+  public:
+    rle_L() {};
+
+    //! builds L from its runs, consecutive runs have different symbols
+    rle_L(const runs_type &runs) {
+        size_type r = runs.size();
+        size_type sigma = 1;
+        for (auto &x : runs) sigma = std::max(sigma, (size_type)x.first + 1);
+
+        sdsl::int_vector<> heads(r, 0, 8);
+        std::vector<size_type> starts(r + 1);
+        m_C.assign(sigma + 1, 0);
+        m_run_C.assign(sigma + 1, 0);
+        for (size_type k = 0; k < r; k++) {
+            heads[k] = runs[k].first;
+            starts[k] = m_size;
+            m_size += runs[k].second;
+            m_C[runs[k].first + 1] += runs[k].second;
+            m_run_C[runs[k].first + 1]++;
+        }
+        starts[r] = m_size;
+        for (size_type c = 0; c < sigma; c++) {
+            m_C[c + 1] += m_C[c];
+            m_run_C[c + 1] += m_run_C[c];
+        }
+        sdsl::construct_im(m_heads, heads);
+        m_starts = sdsl::sd_vector<>(starts.begin(), starts.end());
+
+        // the runs of every symbol start after the earlier ones
+        std::vector<size_type> next(m_C.begin(), m_C.end() - 1);
+        std::vector<size_type> sorted(r + 1);
+        std::vector<size_type> slot(m_run_C.begin(), m_run_C.end() - 1);
+        for (auto &x : runs) {
+            sorted[slot[x.first]++] = next[x.first];
+            next[x.first] += x.second;
+        }
+        sorted[r] = m_size;
+        m_sorted = sdsl::sd_vector<>(sorted.begin(), sorted.end());
+        init_supports();
+    }
+
+    rle_L(const rle_L &other) { *this = other; }
+
+    rle_L &operator=(const rle_L &other) {
+        if (this != &other) {
+            m_size = other.m_size;
+            m_heads = other.m_heads;
+            m_starts = other.m_starts;
+            m_sorted = other.m_sorted;
+            m_C = other.m_C;
+            m_run_C = other.m_run_C;
+            init_supports();
+        }
+        return *this;
+    }
+
+    size_type size() const { return m_size; }
+
+    //! returns the number of runs
+    size_type runs() const { return m_heads.size(); }
+
+    value_type operator[](size_type i) const {
+        return m_heads[m_starts_rank(i + 1) - 1];
+    }
+
+    //! returns the number of occurrences of L[i] in L[0..i) and L[i]
+    std::pair<size_type, value_type> inverse_select(size_type i) const {
+        size_type k = m_starts_rank(i + 1);
+        auto is = m_heads.inverse_select(k - 1);
+        value_type c = is.second;
+        size_type rank = sorted_start(c, is.first) - m_C[c];
+        return std::make_pair(rank + i - m_starts_select(k), c);
+    }
+
+    //! returns the number of occurrences of c in L[0..i)
+    size_type rank(size_type i, value_type c) const {
+        if (i == 0 || c + 1 >= m_C.size()) return 0;
+        size_type k = m_starts_rank(i);
+        auto is = m_heads.inverse_select(k - 1);
+        if (is.second == c) {
+            return sorted_start(c, is.first) - m_C[c] + i - m_starts_select(k);
+        }
+        return sorted_start(c, m_heads.rank(k - 1, c)) - m_C[c];
+    }
+
+    //! returns the position of the r-th occurrence of c, r > 0
+    size_type select(size_type r, value_type c) const {
+        size_type p = m_C[c] + r - 1;
+        size_type t = m_sorted_rank(p + 1) - m_run_C[c];
+        size_type offset = p - sorted_start(c, t - 1);
+        return m_starts_select(m_heads.select(t, c) + 1) + offset;
+    }
+
+    //! serializes opbject
+    size_type serialize(
+        std::ostream &out, sdsl::structure_tree_node *v, std::string name
+    ) const {
+
+        sdsl::structure_tree_node *child = sdsl::structure_tree::add_child(
+            v, name, sdsl::util::class_name(*this)
+        );
+        size_type written_bytes = 0;
+        written_bytes += sdsl::write_member(m_size, out, child, "size");
+        written_bytes += m_heads.serialize(out, child, "heads");
+        written_bytes += m_starts.serialize(out, child, "starts");
+        written_bytes += m_sorted.serialize(out, child, "sorted");
+        written_bytes += sdsl::serialize(m_C, out, child, "C");
+        written_bytes += sdsl::serialize(m_run_C, out, child, "run_C");
+        sdsl::structure_tree::add_size(child, written_bytes);
+        return written_bytes;
+    };
+
+    //! loads a serialized object
+    void load(std::istream &in) {
+        sdsl::read_member(m_size, in);
+        m_heads.load(in);
+        m_starts.load(in);
+        m_sorted.load(in);
+        sdsl::load(m_C, in);
+        sdsl::load(m_run_C, in);
+        init_supports();
+    };
+};
+
+//! the L of a tfm_index, a wavelet tree or, for texts with long runs, a
+//! run-length encoded L. the representation is chosen at construction and
+//! stored with the index
+class tfm_L {
+  public:
+    typedef sdsl::wt_blcd_int<> wt_type;
+    typedef wt_type::size_type size_type;
+    typedef wt_type::value_type value_type;
+
+  private:
+    bool m_rle = false;
+    wt_type m_wt;
+    rle_L m_runs;
+
+  public:
+    tfm_L() {};
+
+    tfm_L(wt_type &&wt) { m_wt.swap(wt); }
+
+    tfm_L(rle_L &&runs) : m_rle(true), m_runs(runs) {}
+
+    //! returns whether L is run-length encoded
+    bool rle() const { return m_rle; }
+
+    //! returns the number of runs of a run-length encoded L
+    size_type runs() const { return m_runs.runs(); }
+
+    size_type size() const { return m_rle ? m_runs.size() : m_wt.size(); }
+
+    value_type operator[](size_type i) const {
+        return m_rle ? m_runs[i] : m_wt[i];
+    }
+
+    //! returns the number of occurrences of L[i] in L[0..i) and L[i]
+    std::pair<size_type, value_type> inverse_select(size_type i) const {
+        if (m_rle) return m_runs.inverse_select(i);
+        auto is = m_wt.inverse_select(i);
+        return std::make_pair((size_type)is.first, (value_type)is.second);
+    }
+
+    //! returns the number of occurrences of c in L[0..i)
+    size_type rank(size_type i, value_type c) const {
+        return m_rle ? m_runs.rank(i, c) : m_wt.rank(i, c);
+    }
+
+    //! returns the position of the r-th occurrence of c, r > 0
+    size_type select(size_type r, value_type c) const {
+        return m_rle ? m_runs.select(r, c) : m_wt.select(r, c);
+    }
+
+    //! serializes opbject
+    size_type serialize(
+        std::ostream &out, sdsl::structure_tree_node *v, std::string name
+    ) const {
+
+        sdsl::structure_tree_node *child = sdsl::structure_tree::add_child(
+            v, name, sdsl::util::class_name(*this)
+        );
+        size_type written_bytes = 0;
+        written_bytes += sdsl::write_member(m_rle, out, child, "rle");
+        if (m_rle) {
+            written_bytes += m_runs.serialize(out, child, "runs");
+        } else {
+            written_bytes += m_wt.serialize(out, child, "wt");
+        }
+        sdsl::structure_tree::add_size(child, written_bytes);
+        return written_bytes;
+    };
+
+    //! loads a serialized object
+    void load(std::istream &in) {
+        sdsl::read_member(m_rle, in);
+        if (m_rle) {
+            m_runs.load(in);
+        } else {
+            m_wt.load(in);
+        }
+    };
+};
+
+#endif
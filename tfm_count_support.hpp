@@ -0,0 +1,158 @@
+#ifndef TFM_COUNT_SUPPORT_HPP
+#define TFM_COUNT_SUPPORT_HPP
+
+#include <sdsl/io.hpp>
+#include <sdsl/sd_vector.hpp>
+#include <sdsl/util.hpp>
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "tfm_index.hpp"
+
+//! a support answering count queries on a tfm_index by backward search.
+//!
+//! an entry j of the tunneled L stands for one or more consecutive rows of
+//! the BWT of the text, namely for all rows whose backward walks use it;
+//! the state (j, o) of a walk is the o-th of these rows. the walk itself
+//! never needs the number of rows of an entry, so it is not part of the
+//! index and the support stores the first row of every entry. t_index is
+//! tfm_index or tfm_index_mmap.
+template <class t_index = tfm_index> class tfm_count_support {
+  public:
+    typedef typename t_index::size_type size_type;
+    typedef typename t_index::value_type value_type;
+    typedef typename t_index::nav_type nav_type;
+
+  private:
+    const t_index *m_tfm = nullptr;
+    uint64_t m_id = 0;         // fingerprint of the index it was built for
+    sdsl::sd_vector<> m_start; // marks the first row of every entry
+    sdsl::sd_vector<>::select_1_type m_start_select;
+
+    //! hashes the sizes, C and a sample of L of tfm, so that the support of
+    //! an earlier build of other text is told apart
+    static uint64_t fingerprint(const t_index &tfm) {
+        uint64_t h = 14695981039346656037ULL;
+        auto add = [&](uint64_t x) { h = (h ^ x) * 1099511628211ULL; };
+        add(tfm.size());
+        add(tfm.L.size());
+        for (size_type c = 0; c < tfm.C.size(); c++) add(tfm.C[c]);
+        size_type step = tfm.L.size() / 64 + 1;
+        for (size_type j = 0; j < tfm.L.size(); j += step) add(tfm.L[j]);
+        return h;
+    }
+
+  public:
+    tfm_count_support() {};
+
+    //! builds the support by a backward walk over the whole text
+    tfm_count_support(const t_index *tfm) : m_tfm(tfm), m_id(fingerprint(*tfm)) {
+        // number of rows of each entry, the walk visits each row once,
+        // except for the row preceded by the text end where it stops
+        std::vector<uint32_t> rows(tfm->L.size(), 0);
+        auto p = tfm->end();
+        for (size_type i = 0; i <= tfm->size(); i++) {
+            rows[p.first] = std::max(rows[p.first], (uint32_t)p.second + 1);
+            if (i < tfm->size()) tfm->backwardstep(p);
+        }
+
+        std::vector<size_type> start(rows.size() + 1, 0);
+        for (size_type j = 0; j < rows.size(); j++) {
+            start[j + 1] = start[j] + rows[j];
+        }
+        sdsl::util::clear(rows);
+        m_start = sdsl::sd_vector<>(start.begin(), start.end());
+        sdsl::util::init_support(m_start_select, &m_start);
+    }
+
+    tfm_count_support(const tfm_count_support &other) { *this = other; }
+
+    tfm_count_support &operator=(const tfm_count_support &other) {
+        if (this != &other) {
+            m_tfm = other.m_tfm;
+            m_id = other.m_id;
+            m_start = other.m_start;
+            m_start_select = other.m_start_select;
+            m_start_select.set_vector(&m_start);
+        }
+        return *this;
+    }
+
+    //! returns the row of the BWT corresponding to a state of a walk
+    size_type row(const nav_type &pos) const {
+        return m_start_select(pos.first + 1) + pos.second;
+    }
+
+    //! returns the state of the last row of entry j
+    nav_type last_state(size_type j) const {
+        size_type rows = m_start_select(j + 2) - m_start_select(j + 1);
+        return std::make_pair(j, rows - 1);
+    }
+
+    //! returns the number of occurrences of pattern in the text
+    size_type count(const std::string &pattern) const {
+        const t_index &tfm = *m_tfm;
+
+        // the rows [s, e] prefixed by the processed suffix of pattern
+        nav_type s = tfm.end();
+        nav_type e = last_state(tfm.L.size() - 1);
+        for (size_type k = pattern.size(); k > 0; k--) {
+            value_type c = (unsigned char)pattern[k - 1];
+            if (c + 1 >= tfm.C.size()) return 0;
+            size_type occ = tfm.C[c + 1] - tfm.C[c];
+
+            // first row at or after s and last row at or before e, which
+            // are preceded by c
+            if (tfm.L[s.first] != c) {
+                size_type r = tfm.L.rank(s.first, c);
+                if (r == occ) return 0;
+                s = std::make_pair(tfm.L.select(r + 1, c), (size_type)0);
+            }
+            if (tfm.L[e.first] != c) {
+                size_type r = tfm.L.rank(e.first, c);
+                if (r == 0) return 0;
+                e = last_state(tfm.L.select(r, c));
+            }
+            if (s.first > e.first || (s.first == e.first && s.second > e.second))
+                return 0;
+
+            tfm.backwardstep(s);
+            tfm.backwardstep(e);
+        }
+        return row(e) - row(s) + 1;
+    }
+
+    void set_vector(const t_index *tfm) { m_tfm = tfm; }
+
+    //! serializes opbject
+    size_type serialize(
+        std::ostream &out, sdsl::structure_tree_node *v, std::string name
+    ) const {
+
+        sdsl::structure_tree_node *child = sdsl::structure_tree::add_child(
+            v, name, sdsl::util::class_name(*this)
+        );
+        size_type written_bytes = 0;
+        written_bytes += sdsl::write_member(m_id, out, child, "id");
+        written_bytes += m_start.serialize(out, child, "start");
+        written_bytes += m_start_select.serialize(out, child, "start_select");
+        sdsl::structure_tree::add_size(child, written_bytes);
+        return written_bytes;
+    };
+
+    //! loads a serialized object, returns false if it was built for another
+    //! index than tfm, e.g. a stale file of an earlier build, or cannot be read
+    bool load(std::istream &in, const t_index *tfm) {
+        m_tfm = tfm;
+        sdsl::read_member(m_id, in);
+        if (!in || m_id != fingerprint(*tfm)) return false;
+        m_start.load(in);
+        m_start_select.load(in, &m_start);
+        return (bool)in;
+    };
+};
+
+#endif
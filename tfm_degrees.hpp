@@ -0,0 +1,298 @@
+#ifndef TFM_DEGREES_HPP
+#define TFM_DEGREES_HPP
+
+#include <stdlib.h>
+
+#include <sdsl/bits.hpp>
+#include <sdsl/int_vector.hpp>
+#include <sdsl/io.hpp>
+#include <sdsl/util.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "parallel.hpp"
+
+//! the din and dout bitvectors of a tfm_index with rank and select support.
+//!
+//! both bitvectors are interleaved in lines of one cache line each: the
+//! number of ones of din and of dout before the line, followed by 192 bits
+//! of din and the same 192 bits of dout. a backward step reads din[i],
+//! din rank(i + 1) and the tunnel end in dout from one line each, instead
+//! of from the bitvectors and the rank supports separately. select keeps
+//! the line of every 512-th one and searches the lines up to the next one.
+class tfm_degrees {
+  public:
+    typedef uint64_t size_type;
+
+  private:
+    static const size_type line_words = 8;
+    static const size_type data_words = 3;   // words of each bitvector per line
+    static const size_type line_bits = 64 * data_words;
+    static const size_type select_rate = 512;
+    static const size_type scan_lines = 8;   // longer searches are binary
+
+    size_type m_size[2] = {0, 0};  // sizes of din and dout
+    size_type m_ones[2] = {0, 0};
+    size_type m_line_cnt = 0;
+    uint64_t *m_lines = nullptr;   // aligned to cache lines
+    std::vector<uint64_t> m_select[2]; // line of every select_rate-th one
+
+    void allocate(size_type lines) {
+        free(m_lines);
+        m_lines = nullptr;
+        m_line_cnt = lines;
+        if (lines == 0) return;
+        void *p = nullptr;
+        if (posix_memalign(&p, 64, lines * line_words * sizeof(uint64_t)) != 0)
+            throw std::bad_alloc();
+        m_lines = (uint64_t *)p;
+    }
+
+    uint64_t &data_word(size_type k, bool out) const {
+        return m_lines[(k / data_words) * line_words + 2 + out * data_words +
+                       k % data_words];
+    }
+
+    size_type ones_before(size_type line, bool out) const {
+        return m_lines[line * line_words + out];
+    }
+
+    // copies the bits of the lines [lo, hi) from bv
+    void fill(const sdsl::bit_vector &bv, bool out, size_type lo, size_type hi) {
+        size_type words = (bv.size() + 63) / 64;
+        for (size_type k = lo * data_words; k < hi * data_words; k++) {
+            uint64_t w = 0;
+            if (k < words) {
+                size_type len = std::min((size_type)64, bv.size() - 64 * k);
+                w = bv.get_int(64 * k, len);
+            }
+            data_word(k, out) = w;
+        }
+    }
+
+    // sets the ones before each line and the select samples
+    void count_ones(bool out) {
+        std::vector<uint64_t> &s = m_select[out];
+        s.clear();
+        size_type ones = 0;
+        for (size_type l = 0; l < m_line_cnt; l++) {
+            m_lines[l * line_words + out] = ones;
+            size_type cnt = 0;
+            for (size_type k = l * data_words; k < (l + 1) * data_words; k++)
+                cnt += sdsl::bits::cnt(data_word(k, out));
+            // the lines holding the ones number j * select_rate + 1
+            while (s.size() * select_rate < ones + cnt) s.push_back(l);
+            ones += cnt;
+        }
+        s.push_back(m_line_cnt - 1);
+        m_ones[out] = ones;
+    }
+
+    size_type select(size_type r, bool out) const {
+        size_type k = (r - 1) / select_rate;
+        // last line with less than r ones before it
+        size_type lo = m_select[out][k], hi = m_select[out][k + 1];
+        if (hi - lo <= scan_lines) {
+            while (lo < hi && ones_before(lo + 1, out) < r) lo++;
+        } else {
+            while (lo < hi) {
+                size_type mid = lo + (hi - lo + 1) / 2;
+                if (ones_before(mid, out) < r) lo = mid;
+                else hi = mid - 1;
+            }
+        }
+        size_type need = r - ones_before(lo, out);
+        for (size_type k = lo * data_words;; k++) {
+            uint64_t w = data_word(k, out);
+            size_type cnt = sdsl::bits::cnt(w);
+            if (cnt >= need) return 64 * k + sdsl::bits::sel(w, need);
+            need -= cnt;
+        }
+    }
+
+    size_type rank(size_type i, bool out) const {
+        size_type line = i / line_bits;
+        const uint64_t *p = m_lines + line * line_words;
+        size_type r = p[out];
+        p += 2 + out * data_words;
+        size_type bits = i % line_bits;
+        for (; bits >= 64; bits -= 64) r += sdsl::bits::cnt(*p++);
+        if (bits) r += sdsl::bits::cnt(*p & sdsl::bits::lo_set[bits]);
+        return r;
+    }
+
+  public:
+    //! din or dout, offers the queries of a bit_vector
+    class bits_view {
+        const tfm_degrees *m_d;
+        bool m_out;
+
+      public:
+        bits_view(const tfm_degrees *d, bool out) : m_d(d), m_out(out) {}
+
+        size_type size() const { return m_d->m_size[m_out]; }
+
+        bool operator[](size_type i) const {
+            return (m_d->data_word(i >> 6, m_out) >> (i & 63)) & 1;
+        }
+
+        //! returns the len bits starting at position idx
+        uint64_t get_int(size_type idx, uint8_t len = 64) const {
+            size_type k = idx >> 6, off = idx & 63;
+            uint64_t w = m_d->data_word(k, m_out) >> off;
+            if (off + len > 64) w |= m_d->data_word(k + 1, m_out) << (64 - off);
+            return len == 64 ? w : w & sdsl::bits::lo_set[len];
+        }
+    };
+
+    tfm_degrees() {};
+
+    //! interleaves din and dout, the lines are filled with the given
+    //! number of threads
+    tfm_degrees(const sdsl::bit_vector &din, const sdsl::bit_vector &dout,
+                size_t threads = 1) {
+        m_size[0] = din.size();
+        m_size[1] = dout.size();
+        // one more line keeps rank(size()) and the select sentinel in range
+        allocate(std::max(m_size[0], m_size[1]) / line_bits + 1);
+
+        size_type chunk = std::max((size_type)1, m_line_cnt / (8 * threads) + 1);
+        size_type chunks = (m_line_cnt + chunk - 1) / chunk;
+        parallel_for(chunks, threads, [&](size_t c) {
+            size_type hi = std::min(m_line_cnt, (c + 1) * chunk);
+            fill(din, false, c * chunk, hi);
+            fill(dout, true, c * chunk, hi);
+        });
+
+        count_ones(false);
+        count_ones(true);
+    }
+
+    tfm_degrees(const tfm_degrees &other) { *this = other; }
+
+    tfm_degrees(tfm_degrees &&other) { *this = std::move(other); }
+
+    ~tfm_degrees() { free(m_lines); }
+
+    tfm_degrees &operator=(const tfm_degrees &other) {
+        if (this != &other) {
+            allocate(other.m_line_cnt);
+            if (m_line_cnt)
+                std::memcpy(m_lines, other.m_lines,
+                            m_line_cnt * line_words * sizeof(uint64_t));
+            for (bool out : {false, true}) {
+                m_size[out] = other.m_size[out];
+                m_ones[out] = other.m_ones[out];
+                m_select[out] = other.m_select[out];
+            }
+        }
+        return *this;
+    }
+
+    tfm_degrees &operator=(tfm_degrees &&other) {
+        if (this != &other) {
+            free(m_lines);
+            m_lines = other.m_lines;
+            m_line_cnt = other.m_line_cnt;
+            other.m_lines = nullptr;
+            other.m_line_cnt = 0;
+            for (bool out : {false, true}) {
+                m_size[out] = other.m_size[out];
+                m_ones[out] = other.m_ones[out];
+                m_select[out] = std::move(other.m_select[out]);
+            }
+        }
+        return *this;
+    }
+
+    //! returns the number of ones in din[0..i)
+    size_type din_rank(size_type i) const { return rank(i, false); }
+
+    //! returns the number of ones in dout[0..i)
+    size_type dout_rank(size_type i) const { return rank(i, true); }
+
+    //! returns the position of the r-th one in din, r > 0
+    size_type din_select(size_type r) const { return select(r, false); }
+
+    //! returns the position of the r-th one in dout, r > 0
+    size_type dout_select(size_type r) const { return select(r, true); }
+
+    //! prefetches the line holding position i of din and dout
+    void prefetch(size_type i) const {
+        __builtin_prefetch(m_lines + (i / line_bits) * line_words);
+    }
+
+    //! returns din (out = false) or dout (out = true) as a bit_vector
+    sdsl::bit_vector to_bit_vector(bool out) const {
+        sdsl::bit_vector bv(m_size[out], 0);
+        bits_view v(this, out);
+        for (size_type k = 0; k < bv.size(); k += 64) {
+            uint8_t len = std::min((size_type)64, bv.size() - k);
+            bv.set_int(k, v.get_int(k, len), len);
+        }
+        return bv;
+    }
+
+    //! serializes opbject
+    size_type serialize(
+        std::ostream &out, sdsl::structure_tree_node *v, std::string name
+    ) const {
+
+        sdsl::structure_tree_node *child = sdsl::structure_tree::add_child(
+            v, name, sdsl::util::class_name(*this)
+        );
+        size_type written_bytes = 0;
+        written_bytes += sdsl::write_member(m_size[0], out, child, "din_size");
+        written_bytes += sdsl::write_member(m_size[1], out, child, "dout_size");
+        written_bytes += sdsl::write_member(m_ones[0], out, child, "din_ones");
+        written_bytes += sdsl::write_member(m_ones[1], out, child, "dout_ones");
+        written_bytes += sdsl::write_member(m_line_cnt, out, child, "lines");
+        size_type bytes = m_line_cnt * line_words * sizeof(uint64_t);
+        out.write((const char *)m_lines, bytes);
+        written_bytes += bytes;
+        // the parts of the lines, for the space breakdown of the index
+        size_type data_bytes = m_line_cnt * data_words * sizeof(uint64_t);
+        sdsl::structure_tree::add_size(
+            sdsl::structure_tree::add_child(child, "din", "bits"), data_bytes);
+        sdsl::structure_tree::add_size(
+            sdsl::structure_tree::add_child(child, "dout", "bits"), data_bytes);
+        sdsl::structure_tree::add_size(
+            sdsl::structure_tree::add_child(child, "rank_samples", "uint64_t"),
+            bytes - 2 * data_bytes);
+        written_bytes += sdsl::serialize(m_select[0], out, child, "din_select");
+        written_bytes += sdsl::serialize(m_select[1], out, child, "dout_select");
+        sdsl::structure_tree::add_size(child, written_bytes);
+        return written_bytes;
+    };
+
+    //! loads a serialized object
+    void load(std::istream &in) {
+        sdsl::read_member(m_size[0], in);
+        sdsl::read_member(m_size[1], in);
+        sdsl::read_member(m_ones[0], in);
+        sdsl::read_member(m_ones[1], in);
+        size_type lines = 0;
+        sdsl::read_member(lines, in);
+        if (!in || lines != std::max(m_size[0], m_size[1]) / line_bits + 1) {
+            throw std::runtime_error("Corrupt tfm_degrees");
+        }
+        allocate(lines);
+        in.read((char *)m_lines, lines * line_words * sizeof(uint64_t));
+        if (!in) throw std::runtime_error("Truncated tfm_degrees");
+        sdsl::load(m_select[0], in);
+        sdsl::load(m_select[1], in);
+    };
+};
+
+//! prints the bits as the output operator of bit_vector
+inline std::ostream &operator<<(std::ostream &os, const tfm_degrees::bits_view &v) {
+    for (tfm_degrees::size_type i = 0; i < v.size(); i++) os << v[i];
+    return os;
+}
+
+#endif
@@ -16,11 +16,18 @@
 #include <sdsl/wavelet_trees.hpp>
 
 #include <algorithm>
+#include <fstream>
 #include <iostream>
 #include <limits>
+#include <stdexcept>
 #include <string>
+#include <thread>
 #include <utility>
 
+#include "tfm_C.hpp"
+#include "tfm_L.hpp"
+#include "tfm_degrees.hpp"
+
 using namespace std;
 using namespace sdsl;
 
@@ -30,52 +37,131 @@ class tfm_index {
     typedef sdsl::int_vector<> text_type;
     typedef sdsl::int_vector<>::size_type size_type;
 
-    typedef sdsl::wt_blcd_int<> wt_type;
-    typedef sdsl::wt_blcd_int<>::value_type value_type;
-    typedef sdsl::wt_blcd_int<>::bit_vector_type bit_vector_type;
-    typedef sdsl::wt_blcd_int<>::bit_vector_type::rank_1_type rank_type;
-    typedef sdsl::wt_blcd_int<>::bit_vector_type::select_1_type select_type;
+    typedef tfm_L wt_type;
+    typedef tfm_L::value_type value_type;
+    typedef tfm_degrees::bits_view bit_vector_type;
 
     // first index is next outgoing edge, second index is tunnel entry offset
     typedef std::pair<size_type, size_type> nav_type;
 
   private:
     size_type text_len; // original textlen
-    sdsl::wt_blcd_int<> m_L;
-    std::vector<size_type> m_C;
-    sdsl::wt_blcd_int<>::bit_vector_type m_dout;
-    rank_type m_dout_rank;
-    select_type m_dout_select;
-    sdsl::wt_blcd_int<>::bit_vector_type m_din;
-    rank_type m_din_rank;
-    select_type m_din_select;
+    tfm_L m_L;
+    tfm_C m_C;
+    tfm_degrees m_degrees; // din and dout with rank and select
+
+    void init_degrees(bit_vector &din, bit_vector &dout) {
+        m_degrees = tfm_degrees(din, dout);
+    }
+
+    // the header of a serialized index: magic, version and layout. the
+    // version is increased whenever the serialization of L, C or the
+    // degrees changes, so that an older index fails to load
+    static const uint64_t magic = 0x5845444e494d4654; // "TFMINDEX"
+    static const uint64_t version = 1;
+    enum layout : uint64_t { full = 0, compact = 1 };
+
+    static size_type write_header(std::ostream &out, sdsl::structure_tree_node *v, uint64_t l) {
+        uint64_t m = magic, ver = version;
+        size_type written_bytes = 0;
+        written_bytes += sdsl::write_member(m, out, v, "magic");
+        written_bytes += sdsl::write_member(ver, out, v, "version");
+        written_bytes += sdsl::write_member(l, out, v, "layout");
+        return written_bytes;
+    }
 
   public:
     const wt_type &L = m_L;
-    const std::vector<size_type> &C = m_C;
-    const bit_vector_type &dout = m_dout;
-    const rank_type &dout_rank = m_dout_rank;
-    const select_type &dout_select = m_dout_select;
-    const bit_vector_type &din = m_din;
-    const rank_type &din_rank = m_din_rank;
-    const select_type &din_select = m_din_select;
+    const tfm_C &C = m_C;
+    const tfm_degrees &degrees = m_degrees;
+    const bit_vector_type dout = bit_vector_type(&m_degrees, true);
+    const bit_vector_type din = bit_vector_type(&m_degrees, false);
+
+    //! returns the number of ones in dout[0..i)
+    size_type dout_rank(size_type i) const { return m_degrees.dout_rank(i); }
+
+    //! returns the position of the r-th one in dout
+    size_type dout_select(size_type r) const { return m_degrees.dout_select(r); }
+
+    //! returns the number of ones in din[0..i)
+    size_type din_rank(size_type i) const { return m_degrees.din_rank(i); }
+
+    //! returns the position of the r-th one in din
+    size_type din_select(size_type r) const { return m_degrees.din_select(r); }
 
     tfm_index() {};
 
-    tfm_index(size_t size, int_vector<> &L, bit_vector &din, bit_vector &dout) {
+    //! L can be any in-memory int_vector, one of fixed width, e.g.
+    //! int_vector<8>, is copied into one of width 0 for the wavelet tree
+    template <uint8_t t_width>
+    tfm_index(size_t size, int_vector<t_width> &L, bit_vector &din, bit_vector &dout) {
+        text_len = size;
+        tfm_L::wt_type wt;
+        construct_wt(wt, L);
+        m_C = get_C(L, wt.sigma);
+        m_L = tfm_L(std::move(wt));
+        init_degrees(din, dout);
+    }
+
+    //! constructs the index from L stored on disk, L is not loaded into memory
+    tfm_index(size_t size, int_vector_buffer<> &L, bit_vector &din, bit_vector &dout) {
         text_len = size;
-        construct_im(m_L, L);
-        m_C = get_C(L, m_L.sigma);
-        m_dout = dout;
-        m_din = din;
-
-        sdsl::util::init_support(m_dout_rank,   &m_dout);
-        sdsl::util::init_support(m_dout_select, &m_dout);
-        sdsl::util::init_support(m_din_rank,    &m_din);
-        sdsl::util::init_support(m_din_select,  &m_din);
+        tfm_L::wt_type wt(L, L.size());
+        m_C = get_C(L, wt.sigma);
+        m_L = tfm_L(std::move(wt));
+        init_degrees(din, dout);
     }
 
-    static vector<uint64_t> get_C(int_vector<> &L, size_t sigma) {
+    //! constructs the index with a run-length encoded L given by its runs
+    tfm_index(size_t size, const rle_L::runs_type &runs, bit_vector &din, bit_vector &dout) {
+        text_len = size;
+        size_t sigma = 0;
+        for (auto &x : runs) sigma = max(sigma, (size_t)x.first + 1);
+        vector<uint64_t> C(max((size_t)255, sigma + 1), 0);
+        for (auto &x : runs) C[x.first + 1] += x.second;
+        for (size_t c = 0; c + 1 < C.size(); c++) C[c + 1] += C[c];
+        m_C = C;
+        m_L = tfm_L(rle_L(runs));
+        init_degrees(din, dout);
+    }
+
+    tfm_index(const tfm_index &other) { *this = other; }
+
+    tfm_index(tfm_index &&other) { *this = std::move(other); }
+
+    tfm_index &operator=(const tfm_index &other) {
+        if (this != &other) {
+            text_len = other.text_len;
+            m_L = other.m_L;
+            m_C = other.m_C;
+            m_degrees = other.m_degrees;
+        }
+        return *this;
+    }
+
+    tfm_index &operator=(tfm_index &&other) {
+        if (this != &other) {
+            text_len = other.text_len;
+            m_L = std::move(other.m_L);
+            m_C = std::move(other.m_C);
+            m_degrees = std::move(other.m_degrees);
+        }
+        return *this;
+    }
+
+    //! the integer wavelet tree reads L as an int_vector of width 0, whose
+    //! serialization stores the width, unlike those of fixed width
+    static void construct_wt(tfm_L::wt_type &wt, int_vector<> &L) { construct_im(wt, L); }
+
+    template <uint8_t t_width>
+    static void construct_wt(tfm_L::wt_type &wt, const int_vector<t_width> &L) {
+        int_vector<> l(L.size(), 0, L.width());
+        for (size_type i = 0; i < L.size(); i++) l[i] = L[i];
+        construct_im(wt, l);
+    }
+
+    template <class t_L>
+    static vector<uint64_t> get_C(t_L &L, size_t sigma) {
         // 255 handles char alphabet, sigma + 1 handles int alphabets
         vector<uint64_t> v(max((size_t)255, sigma + 1), 0);
         for (uint64_t i = 0; i < L.size(); i++) v[L[i] + 1] += 1;
@@ -83,6 +169,72 @@ class tfm_index {
         return v;
     }
 
+    //! returns L decoded into a plain bit-compressed vector
+    text_type decode_L() const {
+        text_type l(m_L.size(), 0);
+        for (size_type i = 0; i < m_L.size(); i++) l[i] = m_L[i];
+        sdsl::util::bit_compress(l);
+        return l;
+    }
+
+    //! a cursor answering din_rank and dout_select queries whose arguments
+    //! mostly increase, by scanning the bitvectors from the previous answer.
+    //! queries far from the previous one fall back to the rank/select supports
+    class scan_cursor {
+        static const size_type max_scan_words = 8;
+
+        const tfm_index &m_tfm;
+        size_type m_i = 0;    // last argument of din_rank
+        size_type m_rank = 0; // din_rank(m_i)
+        size_type m_r = 0;    // last argument of dout_select, 0 if none
+        size_type m_pos = 0;  // dout_select(m_r)
+
+      public:
+        scan_cursor(const tfm_index &tfm) : m_tfm(tfm) {}
+
+        //! returns the number of ones in din[0..i)
+        size_type din_rank(size_type i) {
+            if (i < m_i || i - m_i > 64 * max_scan_words) {
+                m_rank = m_tfm.din_rank(i);
+            } else {
+                size_type k = m_i;
+                for (; k + 64 <= i; k += 64)
+                    m_rank += sdsl::bits::cnt(m_tfm.din.get_int(k, 64));
+                if (k < i)
+                    m_rank += sdsl::bits::cnt(m_tfm.din.get_int(k, i - k));
+            }
+            m_i = i;
+            return m_rank;
+        }
+
+        //! returns the position of the r-th one in dout
+        size_type dout_select(size_type r) {
+            if (m_r == 0 || r < m_r) {
+                m_pos = m_tfm.dout_select(r);
+            } else if (r > m_r) {
+                size_type need = r - m_r;
+                size_type k = m_pos + 1;
+                size_type words = 0;
+                for (; words < max_scan_words && k < m_tfm.dout.size();
+                     words++, k += 64) {
+                    uint8_t len = std::min((size_type)64, m_tfm.dout.size() - k);
+                    uint64_t word = m_tfm.dout.get_int(k, len);
+                    size_type cnt = sdsl::bits::cnt(word);
+                    if (cnt >= need) {
+                        k += sdsl::bits::sel(word, need);
+                        break;
+                    }
+                    need -= cnt;
+                }
+                m_pos = (words < max_scan_words && k < m_tfm.dout.size())
+                            ? k
+                            : m_tfm.dout_select(r);
+            }
+            m_r = r;
+            return m_pos;
+        }
+    };
+
     //! returns the size of the original string
     size_type size() const { return text_len; }
 
@@ -123,6 +275,41 @@ class tfm_index {
         return c;
     };
 
+    //! performs a backward step from each of the k independent positions
+    //! pos[0..k) and stores the results of the steps in c[0..k). the steps
+    //! are interleaved in stages, each stage prefetches what the next one
+    //! reads, so that the cache misses of the different walks overlap
+    void backwardstep(nav_type *pos, value_type *c, size_type k) const {
+        // navigate to next entry, pos[j].first holds the rank of c[j] first
+        for (size_type j = 0; j < k; j++) {
+            auto is = L.inverse_select(pos[j].first);
+            pos[j].first = is.first;
+            c[j] = is.second;
+            m_C.prefetch(c[j]);
+        }
+        for (size_type j = 0; j < k; j++) {
+            pos[j].first += C[c[j]];
+            m_degrees.prefetch(pos[j].first);
+        }
+        // check for the start of a tunnel and navigate to the outedges
+        for (size_type j = 0; j < k; j++) {
+            size_type &i = pos[j].first;
+            auto din_rank_ip1 = din_rank(i + 1);
+            if (din[i] == 0) {
+                pos[j].second = i - din_select(din_rank_ip1);
+            }
+            i = dout_select(din_rank_ip1);
+            m_degrees.prefetch(i + 1);
+        }
+        // check for the end of a tunnel
+        for (size_type j = 0; j < k; j++) {
+            if (dout[pos[j].first + 1] == 0) {
+                pos[j].first += pos[j].second;
+                pos[j].second = 0;
+            }
+        }
+    }
+
     //! serializes opbject
     size_type serialize(
         std::ostream &out, sdsl::structure_tree_node *v, std::string name
@@ -131,32 +318,94 @@ class tfm_index {
         sdsl::structure_tree_node *child = sdsl::structure_tree::add_child(
             v, name, sdsl::util::class_name(*this)
         );
-        size_type written_bytes = 0;
+        size_type written_bytes = write_header(out, child, full);
+        written_bytes += sdsl::write_member(text_len, out, child, "text_len");
+        written_bytes += m_L.serialize(out, child, "L");
+        written_bytes += m_C.serialize(out, child, "C");
+        written_bytes += m_degrees.serialize(out, child, "degrees");
+        sdsl::structure_tree::add_size(child, written_bytes);
+        return written_bytes;
+    };
+
+    //! serializes the object without the rank/select supports, load builds
+    //! them again. the output is smaller, but takes longer to load
+    size_type serialize_compact(
+        std::ostream &out, sdsl::structure_tree_node *v = nullptr,
+        std::string name = ""
+    ) const {
+
+        sdsl::structure_tree_node *child = sdsl::structure_tree::add_child(
+            v, name, sdsl::util::class_name(*this)
+        );
+        size_type written_bytes = write_header(out, child, compact);
         written_bytes += sdsl::write_member(text_len, out, child, "text_len");
         written_bytes += m_L.serialize(out, child, "L");
-        written_bytes += sdsl::serialize(m_C, out, child, "C");
-        written_bytes += m_dout.serialize(out, child, "dout");
-        written_bytes += m_dout_rank.serialize(out, child, "dout_rank");
-        written_bytes += m_dout_select.serialize(out, child, "dout_select");
-        written_bytes += m_din.serialize(out, child, "din");
-        written_bytes += m_din_rank.serialize(out, child, "din_rank");
-        written_bytes += m_din_select.serialize(out, child, "din_select");
+        written_bytes += m_C.serialize(out, child, "C");
+        written_bytes += m_degrees.to_bit_vector(true).serialize(out, child, "dout");
+        written_bytes += m_degrees.to_bit_vector(false).serialize(out, child, "din");
         sdsl::structure_tree::add_size(child, written_bytes);
         return written_bytes;
     };
 
-    //! loads a serialized object
+    //! loads a serialized object, written by serialize or serialize_compact.
+    //! throws std::runtime_error if it is not an index of this version or
+    //! it is truncated
     void load(std::istream &in) {
+        uint64_t h[3] = {0, 0, 0};
+        for (uint64_t &x : h) sdsl::read_member(x, in);
+        if (!in || h[0] != magic) throw std::runtime_error("Not a tfm_index");
+        if (h[1] != version) {
+            throw std::runtime_error("tfm_index of version " + std::to_string(h[1]) +
+                                     ", expected " + std::to_string(version) +
+                                     ", rebuild it");
+        }
         sdsl::read_member(text_len, in);
+        // a component of a truncated file is not read by the next ones
+        auto check = [&]() {
+            if (!in) throw std::runtime_error("Truncated tfm_index");
+        };
         m_L.load(in);
-        sdsl::load(m_C, in);
-        m_dout.load(in);
-        m_dout_rank.load(in, &m_dout);
-        m_dout_select.load(in, &m_dout);
-        m_din.load(in);
-        m_din_rank.load(in, &m_din);
-        m_din_select.load(in, &m_din);
+        check();
+        m_C.load(in);
+        check();
+        if (h[2] == compact) {
+            load_compact_degrees(in);
+        } else {
+            m_degrees.load(in);
+        }
+        check();
     };
+
+  private:
+    // builds the degrees from the din and dout written by serialize_compact
+    void load_compact_degrees(std::istream &in) {
+        bit_vector dout, din;
+        dout.load(in);
+        din.load(in);
+        if (!in) throw std::runtime_error("Truncated tfm_index");
+        size_t threads = std::max(1u, std::thread::hardware_concurrency());
+        m_degrees = tfm_degrees(din, dout, threads);
+    }
 };
 
+//! loads tfm from file, prints the reason and returns false on failure,
+//! e.g. for an index of another version
+inline bool load_index_from_file(tfm_index &tfm, const std::string &file) {
+    try {
+        if (load_from_file(tfm, file)) return true;
+        std::cerr << "Could not load " << file << std::endl;
+    } catch (const std::exception &e) {
+        std::cerr << file << ": " << e.what() << std::endl;
+    }
+    return false;
+}
+
+//! stores tfm with serialize_compact, returns false on failure
+inline bool store_compact_to_file(const tfm_index &tfm, const std::string &file) {
+    std::ofstream out(file, std::ios::binary);
+    if (!out) return false;
+    tfm.serialize_compact(out);
+    return out.good();
+}
+
 #endif
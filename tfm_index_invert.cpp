@@ -1,13 +1,23 @@
 #include <cstdio>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
 #include <deque>
 #include <iostream>
 #include <map>
 #include <sdsl/int_vector.hpp>
 #include <sdsl/io.hpp>
+#include <stdexcept>
 #include <utility>
 #include <vector>
 
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "parallel.hpp"
+#include "stats.hpp"
 #include "tfm_index.hpp"
+#include "tfm_samples.hpp"
 
 using namespace std;
 using namespace sdsl;
@@ -15,22 +25,119 @@ using namespace sdsl;
 typedef typename sdsl::int_vector<>::size_type size_type;
 
 void printUsage(char **argv) {
-    cerr << "USAGE: " << argv[0] << " TFMFILE" << endl;
+    cerr << "USAGE: " << argv[0] << " TFMFILE OUTFILE [THREADS [STATSFILE]]" << endl;
     cerr << "TFMFILE:" << endl;
     cerr << "  File where to store the serialized trie" << endl;
+    cerr << "OUTFILE:" << endl;
+    cerr << "  File where to store the original text" << endl;
+    cerr << "THREADS:" << endl;
+    cerr << "  Number of threads, used if TFMFILE.smp with checkpoints exists"
+         << endl;
+    cerr << "STATSFILE:" << endl;
+    cerr << "  File where to write the time and memory of each stage as JSON"
+         << endl;
+};
+
+// writes the text backwards into its part [end - len, end) of a pre-sized
+// file, at most block_size chars are kept in memory. flush must be called
+// after the last put, it throws std::runtime_error if the file cannot be
+// written
+class backward_writer {
+    static const size_type block_size = 1 << 20;
+
+    int fd;
+    size_type end;          // text position following the buffered chars
+    size_type fill;         // buf[fill..] holds the buffered chars
+    vector<char> buf;
+
+  public:
+    backward_writer(int fd, size_type end, size_type len)
+        : fd(fd), end(end), fill(min(block_size, len)), buf(fill) {}
+
+    void put(char c) {
+        buf[--fill] = c;
+        if (fill == 0) flush();
+    }
+
+    void flush() {
+        size_type len = buf.size() - fill;
+        size_type written = 0;
+        while (written < len) {
+            ssize_t w = pwrite(
+                fd, buf.data() + fill + written, len - written,
+                end - len + written
+            );
+            if (w < 0) throw std::runtime_error(string("Cannot write output: ") + strerror(errno));
+            written += w;
+        }
+        end -= len;
+        fill = buf.size();
+    }
 };
 
+const size_type backward_writer::block_size;
+
+// creates the output file with its final size
+int open_output(string &filename, size_type size) {
+    int fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0 || ftruncate(fd, size) != 0) {
+        perror(filename.c_str());
+        exit(1);
+    }
+    return fd;
+}
+
 void untunnel(tfm_index &tfm, string &filename) {
-    char *original = new char[tfm.size()];
-    auto p = tfm.end();
-    for (size_type i = 0; i < tfm.size(); i++) {
-        char c = (char)tfm.backwardstep(p);
-        original[tfm.size() - i - 1] = c;
+    int fd = open_output(filename, tfm.size());
+    {
+        backward_writer out(fd, tfm.size(), tfm.size());
+        perf_scope counters("untunnel");
+        auto p = tfm.end();
+        for (size_type i = 0; i < tfm.size(); i++) {
+            out.put((char)tfm.backwardstep(p));
+        }
+        out.flush();
     }
+    close(fd);
+}
 
-    FILE *fout = fopen(filename.c_str(), "w");
-    fwrite(original, sizeof(char), tfm.size(), fout);
-    fclose(fout);
+// number of walks advanced in lockstep by one thread
+const size_type batch = 16;
+
+// every thread walks backwards from a batch of sampled states and writes
+// the parts of the text between these and the next samples
+void untunnel(tfm_index &tfm, tfm_samples &samples, string &filename, size_t threads) {
+    int fd = open_output(filename, tfm.size());
+
+    // all parts have samples.rate() chars, except a shorter one at the start
+    size_type full = tfm.size() / samples.rate();
+    perf_scope counters("untunnel");
+    parallel_for((full + batch - 1) / batch, threads, [&](size_type g) {
+        size_type k0 = g * batch;
+        size_type k = min(batch, full - k0);
+        tfm_index::nav_type pos[batch];
+        tfm_index::value_type c[batch];
+        vector<backward_writer> out;
+        out.reserve(k);
+        for (size_type j = 0; j < k; j++) {
+            pos[j] = samples[k0 + j];
+            out.emplace_back(fd, samples.text_pos(k0 + j), samples.rate());
+        }
+        for (size_type i = 0; i < samples.rate(); i++) {
+            tfm.backwardstep(pos, c, k);
+            for (size_type j = 0; j < k; j++) out[j].put((char)c[j]);
+        }
+        for (auto &o : out) o.flush();
+    });
+    if (full < samples.size()) {
+        backward_writer out(fd, samples.text_pos(full), samples.text_pos(full));
+        auto p = samples[full];
+        for (size_type i = samples.text_pos(full); i > 0; i--) {
+            out.put((char)tfm.backwardstep(p));
+        }
+        out.flush();
+    }
+    close(fd);
 }
 
 int main(int argc, char **argv) {
@@ -40,8 +147,41 @@ int main(int argc, char **argv) {
         return 1;
     }
 
-    tfm_index loaded;
-    load_from_file(loaded, argv[1]);
     string filename = argv[2];
-    untunnel(loaded, filename);
+    size_t threads = (argc > 3) ? max(atoi(argv[3]), 1) : 1;
+    string stats_file = (argc > 4) ? argv[4] : "";
+    run_stats stats(!stats_file.empty());
+    stats.set("input", argv[1]);
+    stats.set("threads", threads);
+
+    stats.begin("load");
+    tfm_index loaded;
+    if (!load_index_from_file(loaded, argv[1])) return 1;
+    tfm_samples samples;
+    bool sampled = load_from_file(samples, string(argv[1]) + ".smp");
+    if (sampled && !samples.matches(loaded)) {
+        cerr << argv[1] << ".smp belongs to another index, inverting sequentially"
+             << endl;
+        sampled = false;
+    }
+    stats.end();
+    stats.set("text_len", loaded.size());
+
+    stats.begin("untunnel");
+    try {
+        if (sampled) {
+            untunnel(loaded, samples, filename, threads);
+        } else {
+            untunnel(loaded, filename);
+        }
+    } catch (const std::exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    stats.end();
+
+    if (stats.enabled() && !stats.write_json(stats_file)) {
+        cerr << "Could not write " << stats_file << endl;
+        return 1;
+    }
 }
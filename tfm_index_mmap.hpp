@@ -0,0 +1,512 @@
+#ifndef TFM_INDEX_MMAP_HPP
+#define TFM_INDEX_MMAP_HPP
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <sdsl/bits.hpp>
+#include <sdsl/int_vector.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "tfm_index.hpp"
+
+//! the memory mappable layout of a tfm_index.
+//!
+//! the file is a sequence of 64-bit words in native byte order: a header
+//! (magic, version, text_len and the size and modification time of the
+//! index file it was built from) followed by C, L and the din and dout
+//! bitvectors. every array starts at a multiple of 64 bytes, so that the
+//! structures can be used directly from the mapped file, see
+//! tfm_index_mmap. the version is increased whenever the layout changes
+namespace tfm_mmap {
+
+static const char magic[8] = {'T', 'F', 'M', 'I', 'D', 'X', 'M', 'M'};
+static const uint64_t version = 2;
+static const uint64_t align_bytes = 64;
+
+//! sets size and stamp to the size and modification time of file, zero if
+//! it does not exist
+inline void file_id(const std::string &file, uint64_t &size, uint64_t &stamp) {
+    struct stat st;
+    size = stamp = 0;
+    if (file.empty() || stat(file.c_str(), &st) != 0) return;
+    size = st.st_size;
+    stamp = (uint64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+class writer {
+    std::ofstream m_out;
+    uint64_t m_pos = 0;
+
+  public:
+    writer(const std::string &file) : m_out(file, std::ios::binary) {}
+
+    bool good() const { return m_out.good(); }
+
+    void write(const void *p, uint64_t bytes) {
+        m_out.write((const char *)p, bytes);
+        m_pos += bytes;
+    }
+
+    void align() {
+        static const char zeros[align_bytes] = {};
+        write(zeros, (align_bytes - m_pos % align_bytes) % align_bytes);
+    }
+
+    void word(uint64_t x) { write(&x, sizeof(x)); }
+
+    void words(const uint64_t *p, uint64_t n) {
+        align();
+        write(p, n * sizeof(uint64_t));
+    }
+};
+
+class reader {
+    const char *m_base;
+    uint64_t m_size;
+    uint64_t m_pos = 0;
+    bool m_ok = true;
+
+  public:
+    reader(const void *base, uint64_t size)
+        : m_base((const char *)base), m_size(size) {}
+
+    bool ok() const { return m_ok; }
+
+    uint64_t word() {
+        const uint64_t *p = words(1, false);
+        return p ? *p : 0;
+    }
+
+    //! returns a pointer to the next n words, or nullptr past the end
+    const uint64_t *words(uint64_t n, bool aligned = true) {
+        if (aligned)
+            m_pos += (align_bytes - m_pos % align_bytes) % align_bytes;
+        if (!m_ok || m_pos > m_size || n > (m_size - m_pos) / 8) {
+            m_ok = false;
+            return nullptr;
+        }
+        const uint64_t *p = (const uint64_t *)(m_base + m_pos);
+        m_pos += n * sizeof(uint64_t);
+        return p;
+    }
+};
+
+//! a bitvector with rank and select support over words of a mapped file.
+//! rank stores the number of ones before every block of 512 bits, select
+//! stores the block of every 4096-th one and searches the blocks between
+class bit_vector_view {
+  public:
+    typedef uint64_t size_type;
+
+  private:
+    static const size_type block_words = 8;
+    static const size_type block_bits = 64 * block_words;
+    static const size_type select_rate = 4096;
+
+    size_type m_size = 0;
+    size_type m_ones = 0;
+    const uint64_t *m_bits = nullptr;
+    const uint64_t *m_rank = nullptr;   // ones before each block
+    const uint64_t *m_select = nullptr; // block of every select_rate-th one
+
+    static size_type words_for(size_type bits) { return (bits + 63) / 64; }
+    static size_type blocks_for(size_type bits) {
+        return (words_for(bits) + block_words - 1) / block_words;
+    }
+
+    //! returns the position of the need-th one of the block b
+    size_type select_in_block(size_type b, size_type need, bool ones) const {
+        for (size_type k = b * block_words;; k++) {
+            uint64_t word = ones ? m_bits[k] : ~m_bits[k];
+            size_type cnt = sdsl::bits::cnt(word);
+            if (cnt >= need) return 64 * k + sdsl::bits::sel(word, need);
+            need -= cnt;
+        }
+    }
+
+  public:
+    //! writes the bitvector bv and its supports
+    static void write(writer &out, const sdsl::bit_vector &bv) {
+        size_type n = bv.size();
+        size_type w = words_for(n);
+        size_type nb = blocks_for(n);
+
+        std::vector<uint64_t> words(bv.data(), bv.data() + w);
+        if (n % 64) words[w - 1] &= sdsl::bits::lo_set[n % 64];
+
+        std::vector<uint64_t> rank(nb + 1, 0);
+        std::vector<uint64_t> select;
+        size_type ones = 0;
+        for (size_type b = 0; b < nb; b++) {
+            rank[b] = ones;
+            for (size_type k = b * block_words;
+                 k < std::min(w, (b + 1) * block_words); k++) {
+                size_type cnt = sdsl::bits::cnt(words[k]);
+                // the blocks holding the ones number j * select_rate + 1
+                while (select.size() * select_rate < ones + cnt &&
+                       select.size() * select_rate >= ones)
+                    select.push_back(b);
+                ones += cnt;
+            }
+        }
+        rank[nb] = ones;
+        select.push_back(nb > 0 ? nb - 1 : 0);
+
+        out.word(n);
+        out.word(ones);
+        out.words(words.data(), words.size());
+        out.words(rank.data(), rank.size());
+        out.words(select.data(), select.size());
+    }
+
+    bool read(reader &in) {
+        m_size = in.word();
+        m_ones = in.word();
+        m_bits = in.words(words_for(m_size));
+        m_rank = in.words(blocks_for(m_size) + 1);
+        m_select = in.words((m_ones + select_rate - 1) / select_rate + 1);
+        return in.ok();
+    }
+
+    size_type size() const { return m_size; }
+
+    bool operator[](size_type i) const { return (m_bits[i >> 6] >> (i & 63)) & 1; }
+
+    //! returns the number of ones in [0..i)
+    size_type rank(size_type i) const {
+        size_type b = i / block_bits;
+        size_type r = m_rank[b];
+        for (size_type k = b * block_words; k < (i >> 6); k++)
+            r += sdsl::bits::cnt(m_bits[k]);
+        if (i & 63)
+            r += sdsl::bits::cnt(m_bits[i >> 6] & sdsl::bits::lo_set[i & 63]);
+        return r;
+    }
+
+    //! returns the position of the r-th one, r > 0
+    size_type select(size_type r) const {
+        size_type k = (r - 1) / select_rate;
+        // last block with less than r ones before it
+        size_type lo = m_select[k], hi = m_select[k + 1];
+        while (lo < hi) {
+            size_type mid = lo + (hi - lo + 1) / 2;
+            if (m_rank[mid] < r) lo = mid;
+            else hi = mid - 1;
+        }
+        return select_in_block(lo, r - m_rank[lo], true);
+    }
+
+    //! returns the position of the r-th zero, r > 0
+    size_type select0(size_type r) const {
+        size_type lo = 0, hi = blocks_for(m_size) - 1;
+        while (lo < hi) {
+            size_type mid = lo + (hi - lo + 1) / 2;
+            if (mid * block_bits - m_rank[mid] < r) lo = mid;
+            else hi = mid - 1;
+        }
+        return select_in_block(lo, r - (lo * block_bits - m_rank[lo]), false);
+    }
+};
+
+//! a wavelet matrix over words of a mapped file, offering the queries of
+//! wt_blcd_int that are used on the L of a tfm_index
+class wavelet_matrix_view {
+  public:
+    typedef uint64_t size_type;
+    typedef uint64_t value_type;
+
+  private:
+    size_type m_size = 0;
+    size_type m_sigma = 0;
+    const uint64_t *m_zeros = nullptr; // zeros of each level
+    const uint64_t *m_start = nullptr; // first position of each symbol below
+    std::vector<bit_vector_view> m_levels;
+
+    static size_type levels_for(size_type sigma) {
+        size_type levels = 1;
+        while (levels < 64 && (sigma - 1) >> levels) levels++;
+        return levels;
+    }
+
+  public:
+    //! writes a wavelet matrix of the values of L
+    template <class t_L> static void write(writer &out, const t_L &L) {
+        size_type n = L.size();
+        size_type sigma = 1;
+        for (size_type i = 0; i < n; i++) sigma = std::max(sigma, (size_type)L[i] + 1);
+        size_type levels = levels_for(sigma);
+
+        std::vector<uint64_t> zeros(levels);
+        std::vector<sdsl::bit_vector> bvs(levels);
+        sdsl::int_vector<> cur(L), next(n, 0, cur.width());
+        for (size_type l = 0; l < levels; l++) {
+            size_type shift = levels - 1 - l;
+            bvs[l] = sdsl::bit_vector(n, 0);
+            size_type z = 0;
+            for (size_type i = 0; i < n; i++) {
+                if ((cur[i] >> shift) & 1) bvs[l][i] = 1;
+                else z++;
+            }
+            size_type lo = 0, hi = z;
+            for (size_type i = 0; i < n; i++) {
+                if ((cur[i] >> shift) & 1) next[hi++] = cur[i];
+                else next[lo++] = cur[i];
+            }
+            zeros[l] = z;
+            cur.swap(next);
+        }
+
+        // in the last level the values are ordered by their reversed bits
+        std::vector<uint64_t> cnt(sigma, 0);
+        for (size_type i = 0; i < n; i++) cnt[cur[i]]++;
+        sdsl::util::clear(cur);
+        sdsl::util::clear(next);
+        std::vector<std::pair<uint64_t, uint64_t>> rev(sigma);
+        for (size_type c = 0; c < sigma; c++) {
+            uint64_t r = 0;
+            for (size_type l = 0; l < levels; l++) r |= ((c >> l) & 1) << (levels - 1 - l);
+            rev[c] = std::make_pair(r, c);
+        }
+        std::sort(rev.begin(), rev.end());
+        std::vector<uint64_t> start(sigma, 0);
+        for (size_type k = 0, s = 0; k < sigma; k++) {
+            start[rev[k].second] = s;
+            s += cnt[rev[k].second];
+        }
+
+        out.word(n);
+        out.word(sigma);
+        out.word(levels);
+        out.words(zeros.data(), zeros.size());
+        out.words(start.data(), start.size());
+        for (auto &bv : bvs) bit_vector_view::write(out, bv);
+    }
+
+    bool read(reader &in) {
+        m_size = in.word();
+        m_sigma = in.word();
+        size_type levels = in.word();
+        if (!in.ok() || levels == 0 || levels > 64) return false;
+        m_zeros = in.words(levels);
+        m_start = in.words(m_sigma);
+        m_levels.assign(levels, bit_vector_view());
+        for (auto &bv : m_levels) bv.read(in);
+        return in.ok();
+    }
+
+    size_type size() const { return m_size; }
+
+    size_type sigma() const { return m_sigma; }
+
+    value_type operator[](size_type i) const { return inverse_select(i).second; }
+
+    //! returns the number of occurrences of L[i] in L[0..i) and L[i]
+    std::pair<size_type, value_type> inverse_select(size_type i) const {
+        value_type c = 0;
+        for (size_type l = 0; l < m_levels.size(); l++) {
+            const bit_vector_view &bv = m_levels[l];
+            size_type r = bv.rank(i);
+            if (bv[i]) {
+                c = (c << 1) | 1;
+                i = m_zeros[l] + r;
+            } else {
+                c <<= 1;
+                i -= r;
+            }
+        }
+        return std::make_pair(i - m_start[c], c);
+    }
+
+    //! returns the number of occurrences of c in L[0..i)
+    size_type rank(size_type i, value_type c) const {
+        if (c >= m_sigma) return 0;
+        for (size_type l = 0; l < m_levels.size(); l++) {
+            size_type r = m_levels[l].rank(i);
+            if ((c >> (m_levels.size() - 1 - l)) & 1) i = m_zeros[l] + r;
+            else i -= r;
+        }
+        return i - m_start[c];
+    }
+
+    //! returns the position of the r-th occurrence of c, r > 0
+    size_type select(size_type r, value_type c) const {
+        size_type i = m_start[c] + r - 1;
+        for (size_type l = m_levels.size(); l > 0; l--) {
+            if ((c >> (m_levels.size() - l)) & 1)
+                i = m_levels[l - 1].select(i - m_zeros[l - 1] + 1);
+            else
+                i = m_levels[l - 1].select0(i + 1);
+        }
+        return i;
+    }
+};
+
+//! an array of words of a mapped file
+class array_view {
+    const uint64_t *m_data = nullptr;
+    uint64_t m_size = 0;
+
+  public:
+    bool read(reader &in) {
+        m_size = in.word();
+        m_data = in.words(m_size);
+        return in.ok();
+    }
+
+    uint64_t size() const { return m_size; }
+
+    const uint64_t &operator[](uint64_t i) const { return m_data[i]; }
+};
+
+} // namespace tfm_mmap
+
+//! a read-only tfm_index used directly from a memory mapped file written
+//! by store, so that loading takes no time and processes mapping the same
+//! file share its pages. offers the navigation of tfm_index
+class tfm_index_mmap {
+  public:
+    typedef tfm_index::size_type size_type;
+    typedef tfm_index::value_type value_type;
+    typedef tfm_index::nav_type nav_type;
+    typedef tfm_mmap::wavelet_matrix_view wt_type;
+    typedef tfm_mmap::bit_vector_view bit_vector_type;
+
+  private:
+    void *m_map = nullptr;
+    size_t m_map_size = 0;
+
+    size_type text_len = 0;
+    uint64_t m_index_size = 0;  // size and modification time of the index
+    uint64_t m_index_stamp = 0; // file it was built from
+    tfm_mmap::array_view m_C;
+    wt_type m_L;
+    bit_vector_type m_dout;
+    bit_vector_type m_din;
+
+  public:
+    const wt_type &L = m_L;
+    const tfm_mmap::array_view &C = m_C;
+    const bit_vector_type &dout = m_dout;
+    const bit_vector_type &din = m_din;
+
+    tfm_index_mmap() {};
+
+    tfm_index_mmap(const tfm_index_mmap &) = delete;
+    tfm_index_mmap &operator=(const tfm_index_mmap &) = delete;
+
+    ~tfm_index_mmap() { close(); }
+
+    //! writes tfm in the mappable layout, returns false on failure. if
+    //! index_file is given, tfm has to be stored in it already, built_from
+    //! then tells whether a mapped file belongs to it
+    static bool store(const tfm_index &tfm, const std::string &file,
+                      const std::string &index_file = "") {
+        tfm_mmap::writer out(file);
+        out.write(tfm_mmap::magic, sizeof(tfm_mmap::magic));
+        out.word(tfm_mmap::version);
+        out.word(tfm.size());
+        uint64_t size, stamp;
+        tfm_mmap::file_id(index_file, size, stamp);
+        out.word(size);
+        out.word(stamp);
+
+        std::vector<uint64_t> C = tfm.C.to_vector();
+        out.word(C.size());
+        out.words(C.data(), C.size());
+        tfm_mmap::wavelet_matrix_view::write(out, tfm.decode_L());
+        tfm_mmap::bit_vector_view::write(out, tfm.degrees.to_bit_vector(true));
+        tfm_mmap::bit_vector_view::write(out, tfm.degrees.to_bit_vector(false));
+        return out.good();
+    }
+
+    //! maps a file written by store, returns false if it cannot be mapped
+    //! or has another layout
+    bool open(const std::string &file) {
+        close();
+        int fd = ::open(file.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        m_map_size = st.st_size;
+        m_map = mmap(nullptr, m_map_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (m_map == MAP_FAILED) {
+            m_map = nullptr;
+            return false;
+        }
+
+        tfm_mmap::reader in(m_map, m_map_size);
+        const uint64_t *magic = in.words(1, false);
+        bool ok = magic &&
+                  std::memcmp(magic, tfm_mmap::magic, sizeof(tfm_mmap::magic)) == 0 &&
+                  in.word() == tfm_mmap::version;
+        text_len = in.word();
+        m_index_size = in.word();
+        m_index_stamp = in.word();
+        ok = ok && m_C.read(in) && m_L.read(in) && m_dout.read(in) &&
+             m_din.read(in);
+        if (!ok) close();
+        return ok;
+    }
+
+    //! returns whether the mapped file was stored from index_file as it is
+    //! now, false for a stale file of an earlier build
+    bool built_from(const std::string &index_file) const {
+        uint64_t size, stamp;
+        tfm_mmap::file_id(index_file, size, stamp);
+        return size != 0 && size == m_index_size && stamp == m_index_stamp;
+    }
+
+    void close() {
+        if (m_map) munmap(m_map, m_map_size);
+        m_map = nullptr;
+        m_map_size = 0;
+    }
+
+    //! returns the size of the original string
+    size_type size() const { return text_len; }
+
+    //! returns the end, i.e. the position in L where the string ends
+    nav_type end() const { return std::make_pair((size_type)0, (size_type)0); }
+
+    //! returns the character preceding the current position
+    value_type preceding_char(const nav_type &pos) const {
+        return L[pos.first];
+    }
+
+    //! performs a backward step as tfm_index::backwardstep
+    value_type backwardstep(nav_type &pos) const {
+        size_type &i = pos.first;
+        size_type &o = pos.second;
+
+        auto is = L.inverse_select(i);
+        auto c = is.second;
+        i = C[c] + is.first;
+
+        auto din_rank_ip1 = din.rank(i + 1);
+        if (din[i] == 0) {
+            o = i - din.select(din_rank_ip1);
+        }
+        i = dout.select(din_rank_ip1);
+
+        if (dout[i + 1] == 0) {
+            i += o;
+            o = 0;
+        }
+        return c;
+    };
+};
+
+#endif
@@ -0,0 +1,155 @@
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sdsl/io.hpp>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "tfm_count_support.hpp"
+#include "tfm_index.hpp"
+#include "tfm_index_mmap.hpp"
+#include "tfm_samples.hpp"
+
+using namespace std;
+using namespace sdsl;
+
+void printUsage(char **argv) {
+    cerr << "USAGE: " << argv[0] << " [-x] [-m] TFMFILE QUERYFILE" << endl;
+    cerr << "-x:" << endl;
+    cerr << "  Extract substrings instead of counting patterns" << endl;
+    cerr << "-m:" << endl;
+    cerr << "  Map TFMFILE.mm, written by tfm_index_construct.x -m, instead of "
+            "loading TFMFILE"
+         << endl;
+    cerr << "TFMFILE:" << endl;
+    cerr << "  File with the serialized index, counting uses TFMFILE.cnt if it "
+            "exists, extraction needs TFMFILE.smp"
+         << endl;
+    cerr << "QUERYFILE:" << endl;
+    cerr << "  File with one pattern per line, or with one POS LEN pair per "
+            "line for -x"
+         << endl;
+};
+
+double seconds_since(chrono::steady_clock::time_point start) {
+    chrono::duration<double> d = chrono::steady_clock::now() - start;
+    return d.count();
+}
+
+template <class t_index>
+void count(const t_index &tfm, string tfm_file, string query_file) {
+    tfm_count_support<t_index> cnt;
+    ifstream cnt_in(tfm_file + ".cnt", ios::binary);
+    if (!cnt_in) {
+        cerr << "No " << tfm_file << ".cnt found, building it" << endl;
+        cnt = tfm_count_support<t_index>(&tfm);
+    } else if (!cnt.load(cnt_in, &tfm)) {
+        cerr << tfm_file << ".cnt belongs to another index, building it" << endl;
+        cnt = tfm_count_support<t_index>(&tfm);
+    }
+
+    vector<string> patterns;
+    ifstream in(query_file);
+    for (string line; getline(in, line);) patterns.push_back(line);
+
+    vector<typename t_index::size_type> counts(patterns.size());
+    size_t chars = 0;
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < patterns.size(); i++) {
+        counts[i] = cnt.count(patterns[i]);
+        chars += patterns[i].size();
+    }
+    double time = seconds_since(start);
+
+    for (auto c : counts) cout << c << "\n";
+    cerr << "patterns: " << patterns.size() << "\ttime: " << time << " s"
+         << "\tpatterns/s: " << patterns.size() / time
+         << "\tchars/s: " << chars / time << endl;
+}
+
+template <class t_index>
+void extract(const t_index &tfm, string tfm_file, string query_file) {
+    tfm_samples samples;
+    if (!load_from_file(samples, tfm_file + ".smp")) {
+        cerr << "Extraction needs " << tfm_file
+             << ".smp, build the index with -s" << endl;
+        exit(1);
+    }
+    if (!samples.matches(tfm)) {
+        cerr << tfm_file << ".smp belongs to another index, rebuild it with -s"
+             << endl;
+        exit(1);
+    }
+    size_t bytes = size_in_bytes(samples);
+    cerr << "checkpoints: " << samples.size() << "\tbytes: " << bytes
+         << "\tbits per char: " << 8.0 * bytes / tfm.size() << endl;
+
+    vector<pair<size_t, size_t>> ranges;
+    ifstream in(query_file);
+    for (size_t pos, len; in >> pos >> len;) ranges.emplace_back(pos, len);
+
+    vector<string> substrings(ranges.size());
+    size_t chars = 0;
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < ranges.size(); i++) {
+        substrings[i] = samples.extract(tfm, ranges[i].first, ranges[i].second);
+        chars += substrings[i].size();
+    }
+    double time = seconds_since(start);
+
+    for (auto &s : substrings) cout << s << "\n";
+    cerr << "ranges: " << ranges.size() << "\ttime: " << time << " s"
+         << "\tranges/s: " << ranges.size() / time
+         << "\tchars/s: " << chars / time << endl;
+}
+
+int main(int argc, char **argv) {
+    bool extract_mode = false;
+    bool mmap_mode = false;
+    int c;
+    while ((c = getopt(argc, argv, "xmh")) != -1) {
+        switch (c) {
+            case 'x':
+                extract_mode = true;
+                break;
+            case 'm':
+                mmap_mode = true;
+                break;
+            default:
+                printUsage(argv);
+                return 1;
+        }
+    }
+    if (argc - optind < 2) {
+        printUsage(argv);
+        cerr << "At least 2 parameter expected" << endl;
+        return 1;
+    }
+
+    string tfm_file = argv[optind];
+    string query_file = argv[optind + 1];
+    auto start = chrono::steady_clock::now();
+    if (mmap_mode) {
+        tfm_index_mmap tfm;
+        if (!tfm.open(tfm_file + ".mm")) {
+            cerr << "Could not map " << tfm_file << ".mm" << endl;
+            return 1;
+        }
+        if (!tfm.built_from(tfm_file)) {
+            cerr << tfm_file << ".mm belongs to another index, rebuild it with -m"
+                 << endl;
+            return 1;
+        }
+        cerr << "load time: " << seconds_since(start) << " s" << endl;
+        if (extract_mode) extract(tfm, tfm_file, query_file);
+        else count(tfm, tfm_file, query_file);
+    } else {
+        tfm_index tfm;
+        if (!load_index_from_file(tfm, tfm_file)) return 1;
+        cerr << "load time: " << seconds_since(start) << " s" << endl;
+        if (extract_mode) extract(tfm, tfm_file, query_file);
+        else count(tfm, tfm_file, query_file);
+    }
+    return 0;
+}
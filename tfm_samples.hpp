@@ -0,0 +1,120 @@
+#ifndef TFM_SAMPLES_HPP
+#define TFM_SAMPLES_HPP
+
+#include <sdsl/int_vector.hpp>
+#include <sdsl/io.hpp>
+#include <sdsl/util.hpp>
+
+#include <algorithm>
+#include <string>
+#include <utility>
+
+#include "tfm_index.hpp"
+
+//! states of the backward walk over a tfm_index sampled every rate steps.
+//! the k-th sample is the state reached after k * rate backward steps from
+//! tfm.end(), i.e. the walk continuing from it produces the text backwards
+//! from position text_pos(k) - 1
+class tfm_samples {
+  public:
+    typedef tfm_index::size_type size_type;
+    typedef tfm_index::nav_type nav_type;
+
+  private:
+    size_type m_rate = 0;
+    size_type text_len = 0;
+    sdsl::int_vector<> m_edge;   // first component of the sampled states
+    sdsl::int_vector<> m_offset; // second component of the sampled states
+
+  public:
+    tfm_samples() {};
+
+    tfm_samples(const tfm_index &tfm, size_type rate) {
+        m_rate = rate;
+        text_len = tfm.size();
+        m_edge = sdsl::int_vector<>((text_len + rate - 1) / rate, 0);
+        m_offset = sdsl::int_vector<>(m_edge.size(), 0);
+
+        auto p = tfm.end();
+        for (size_type i = 0; i < text_len; i++) {
+            if (i % rate == 0) {
+                m_edge[i / rate] = p.first;
+                m_offset[i / rate] = p.second;
+            }
+            tfm.backwardstep(p);
+        }
+        sdsl::util::bit_compress(m_edge);
+        sdsl::util::bit_compress(m_offset);
+    }
+
+    //! returns the number of samples
+    size_type size() const { return m_edge.size(); }
+
+    //! returns the sampling rate
+    size_type rate() const { return m_rate; }
+
+    //! returns the k-th sampled state
+    nav_type operator[](size_type k) const {
+        return std::make_pair((size_type)m_edge[k], (size_type)m_offset[k]);
+    }
+
+    //! returns whether the samples were taken from tfm: its text length,
+    //! their number and the state rate steps from tfm.end(). a stale file of
+    //! an earlier build fails this. t_index is tfm_index or tfm_index_mmap
+    template <class t_index>
+    bool matches(const t_index &tfm) const {
+        if (m_rate == 0 || text_len != tfm.size()) return false;
+        if (size() != (text_len + m_rate - 1) / m_rate) return false;
+        if (size() < 2) return true;
+        nav_type p = tfm.end();
+        for (size_type i = 0; i < m_rate; i++) tfm.backwardstep(p);
+        return p == (*this)[1];
+    }
+
+    //! returns the text position preceded by the k-th sampled state
+    size_type text_pos(size_type k) const { return text_len - k * m_rate; }
+
+    //! returns the substring of length len starting at position i of the
+    //! text of tfm, by a walk from the nearest sample following it. t_index
+    //! is tfm_index or tfm_index_mmap
+    template <class t_index>
+    std::string extract(const t_index &tfm, size_type i, size_type len) const {
+        i = std::min(i, text_len);
+        len = std::min(len, text_len - i);
+        std::string s(len, 0);
+        if (len == 0) return s;
+
+        size_type k = (text_len - (i + len)) / m_rate;
+        nav_type p = (*this)[k];
+        for (size_type j = text_pos(k); j > i + len; j--) tfm.backwardstep(p);
+        for (size_type j = len; j > 0; j--) s[j - 1] = (char)tfm.backwardstep(p);
+        return s;
+    }
+
+    //! serializes opbject
+    size_type serialize(
+        std::ostream &out, sdsl::structure_tree_node *v, std::string name
+    ) const {
+
+        sdsl::structure_tree_node *child = sdsl::structure_tree::add_child(
+            v, name, sdsl::util::class_name(*this)
+        );
+        size_type written_bytes = 0;
+        written_bytes += sdsl::write_member(m_rate, out, child, "rate");
+        written_bytes += sdsl::write_member(text_len, out, child, "text_len");
+        written_bytes += m_edge.serialize(out, child, "edge");
+        written_bytes += m_offset.serialize(out, child, "offset");
+        sdsl::structure_tree::add_size(child, written_bytes);
+        return written_bytes;
+    };
+
+    //! loads a serialized object
+    void load(std::istream &in) {
+        sdsl::read_member(m_rate, in);
+        sdsl::read_member(text_len, in);
+        m_edge.load(in);
+        m_offset.load(in);
+    };
+};
+
+#endif